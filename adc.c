@@ -25,6 +25,7 @@
 
 //adc results
 __xdata uint16_t adc_data[2];
+__xdata uint8_t adc_stat_dma_miss;
 
 
 void adc_init(void){
@@ -32,6 +33,7 @@ void adc_init(void){
 
     adc_data[0] = 0;
     adc_data[1] = 0;
+    adc_stat_dma_miss = 0;
 
     //pin config -> dir = input
     P0DIR &= ~((1<<ADC1) | (1<<ADC0));
@@ -74,6 +76,9 @@ void adc_process(void){
     }else{
         //oops this should not happen
         debug_putc('D');
+        if (adc_stat_dma_miss != 0xFF){
+            adc_stat_dma_miss++;
+        }
         //cancel and re arm dma
         //DMAARM = DMA_ARM_ABORT | (DMA_ARM_CH1 | DMA_ARM_CH2);
     }
@@ -125,6 +130,54 @@ uint8_t adc_get_scaled(uint8_t ch){
     }
 }
 
+//voltage in 0.1V steps (hub sensor format)
+//uses 32bit mul + shift only, do not call this from an isr anyway
+uint16_t adc_get_voltage(void){
+    //convert to 10 bit (see adc_get_scaled), voltage sensor is on adc_data[1]
+    uint16_t raw = adc_data[1] >> 6;
+
+    return ADC_VOLTAGE_FROM_RAW(raw);
+}
+
+//current in 0.1A steps (hub sensor format), negative currents read as 0
+uint16_t adc_get_current(void){
+    //convert to 10 bit (see adc_get_scaled), current sensor is on adc_data[0]
+    uint16_t raw = adc_data[0] >> 6;
+
+    #if ADC1_USE_ACS712
+    return ADC_ACS712_INVERTED_CURRENT_FROM_RAW(raw);
+    #else
+    return ADC_ACS712_CURRENT_FROM_RAW(raw);
+    #endif
+}
+
+//internal temperature sensor, ~1 lsb per deg c. averaged over a few
+//conversions, a single noisy reading must not invalidate the pll cache.
+//must be called before adc_init(), the channel sequence is not running then
+uint16_t adc_get_temperature(void){
+    uint8_t i;
+    uint16_t res;
+    uint16_t sum = 0;
+
+    for(i=0; i<ADC_TEMPERATURE_SAMPLES; i++){
+        //internal 1.25V vref, 10 bit, temperature sensor. this starts a conversion
+        //(ADCCON3 uses the same bit layout as ADCCON2)
+        ADCCON3 = ADCCON2_SREF_INT | ADCCON2_SDIV_10BIT | ADCCON2_SCH_TEMP;
+
+        //wait for end of conversion
+        while(!(ADCCON1 & ADCCON1_EOC));
+
+        //adc data is HHHHHHHHLLLL0000, read low byte first
+        res = ADCL;
+        res |= ((uint16_t)ADCH) << 8;
+
+        //convert to 10 bit
+        sum += res >> 6;
+    }
+
+    return sum / ADC_TEMPERATURE_SAMPLES;
+}
+
 void adc_test(void){
     debug("adc: running test\n"); debug_flush();
 
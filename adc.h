@@ -1,12 +1,23 @@
 #ifndef __ADC_H__
 #define __ADC_H__
 #include "main.h"
+#include "config.h"
+
+//reference and scale factors of the voltage/current conversion
+#include "adc_calc.h"
+
+//temperature readings averaged by adc_get_temperature()
+#define ADC_TEMPERATURE_SAMPLES 8
 
 //adc results
 extern __xdata uint16_t adc_data[2];
+//adc dma transfers that were not finished in time
+extern __xdata uint8_t adc_stat_dma_miss;
 
 void adc_init(void);
 uint8_t adc_get_scaled(uint8_t ch);
+uint16_t adc_get_voltage(void);
+uint16_t adc_get_current(void);
 void adc_arm_dma(void);
 void adc_dma_init(uint8_t dma_id, uint16_t __xdata *dest_adr, uint8_t trig);
 uint8_t adc_dma_done(void);
@@ -14,5 +25,6 @@ uint8_t adc_dma_done(void);
 
 void adc_test(void);
 void adc_process(void);
+uint16_t adc_get_temperature(void);
 
 #endif
@@ -0,0 +1,36 @@
+#ifndef __ADC_CALC_H__
+#define __ADC_CALC_H__
+//conversion of raw adc readings to hub sensor units. plain integer math,
+//no cc2510 headers here: this is built on the host by test/test_adc.c
+#include <stdint.h>
+#include "config.h"
+
+//adc reference (avdd) in mV, 10bit results use 0..511 for 0..vref
+#define ADC_VREF_MV     3300
+#define ADC_FULL_SCALE  512
+
+//voltage sensor: raw * vref/512 * (a+b)/b in 0.1V steps.
+//scale factor in 1/65536, folded at compile time
+#define ADC_VOLTAGE_SCALE_Q16 ((uint32_t)((((ADC_VREF_MV / 100L) * (ADC0_DIVIDER_A + ADC0_DIVIDER_B)) << 16) \
+                              / ((long)ADC_FULL_SCALE * ADC0_DIVIDER_B)))
+
+//acs712-30A current sensor: 66mV/A, 0A = 2.5V
+#define ADC_ACS712_MV_PER_A 66
+#define ADC_ACS712_ZERO_MV  2500
+//zero current adc reading in 1/256 lsb
+#define ADC_ACS712_ZERO_Q8  ((uint32_t)(((long)ADC_ACS712_ZERO_MV * ADC_FULL_SCALE * 256) / ADC_VREF_MV))
+//0.1A per adc lsb in 1/256
+#define ADC_ACS712_SCALE_Q8 ((uint32_t)(((long)ADC_VREF_MV * 10 * 256) / ((long)ADC_FULL_SCALE * ADC_ACS712_MV_PER_A)))
+
+//10 bit reading (0..511) to 0.1V, 32bit mul + shift only
+#define ADC_VOLTAGE_FROM_RAW(_raw) ((uint16_t)(((uint32_t)(_raw) * ADC_VOLTAGE_SCALE_Q16) >> 16))
+//10 bit reading to 0.1A, negative currents read as 0
+#define ADC_RAW_Q8(_raw) (((uint32_t)(_raw)) << 8)
+//normal mode, 0A = 2.5V, 30A = 4.5V
+#define ADC_ACS712_CURRENT_FROM_RAW(_raw) ((ADC_RAW_Q8(_raw) <= ADC_ACS712_ZERO_Q8) ? 0 : \
+        (uint16_t)(((ADC_RAW_Q8(_raw) - ADC_ACS712_ZERO_Q8) * ADC_ACS712_SCALE_Q8) >> 16))
+//inverted mode, 0A = 2.5V, 30A = 0.0V
+#define ADC_ACS712_INVERTED_CURRENT_FROM_RAW(_raw) ((ADC_RAW_Q8(_raw) >= ADC_ACS712_ZERO_Q8) ? 0 : \
+        (uint16_t)(((ADC_ACS712_ZERO_Q8 - ADC_RAW_Q8(_raw)) * ADC_ACS712_SCALE_Q8) >> 16))
+
+#endif
@@ -66,7 +66,7 @@ void apa102_show_no_connection(void){
     apa102_flush();
 }
 
-void apa102_update_leds(__xdata uint16_t *data, uint8_t link_qual){
+void apa102_update_leds(__xdata uint16_t *data, uint8_t link_qual, uint8_t rssi){
     uint8_t i;
     uint8_t led[3] = {0,0,0};
     uint16_t throttle;
@@ -94,12 +94,13 @@ void apa102_update_leds(__xdata uint16_t *data, uint8_t link_qual){
         led[0] = (APA102_NEUTRAL_THROTTLE-throttle)>>4; //R
     }
 
-    if (link_qual < 40){
+    //warn on a bad link quality or a low (filtered) rssi
+    if ((link_qual < 40) || (rssi < APA102_RSSI_CRITICAL)){
         //bad -> red
         led[0] = 180; //R
         led[1] =   0; //G
         led[2] =   0; //B
-    }else if (link_qual < 60){
+    }else if ((link_qual < 60) || (rssi < APA102_RSSI_LOW)){
         //somewhat bad, yellow
         led[0] = 120; //R
         led[1] = 120; //G
@@ -7,6 +7,10 @@
 //how many leds?
 #define APA102_LED_COUNT 6
 
+//rssi warning levels (frsky format), same as the tx side alarm defaults
+#define APA102_RSSI_LOW      45
+#define APA102_RSSI_CRITICAL 42
+
 //led data is:
 //4   x 0x00
 //n   x 0xFF BB GG RR
@@ -19,7 +23,7 @@ void apa102_start_transmission(void);
 uint8_t apa102_statemachine(void);
 void apa102_flush(void);
 void apa102_set_rgb(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
-void apa102_update_leds(__xdata uint16_t *data, uint8_t link_qual);
+void apa102_update_leds(__xdata uint16_t *data, uint8_t link_qual, uint8_t rssi);
 void apa102_show_no_connection(void);
 
 #endif
@@ -2,6 +2,18 @@
 
 //send ADC data as hub telemetry as well:
 #define FRSKY_SEND_HUB_TELEMETRY 0
+//add receiver diagnostics counters to the hub telemetry (see frsky_telemetry_sensors)
+#define FRSKY_TELEMETRY_DIAGNOSTICS 1
+//forward hub sensor data (gps, vario, flvss, ...) received on the uart rx pin
+//(P0_2, 9600 baud, 8N1, NOT inverted) as hub telemetry. needs FRSKY_SEND_HUB_TELEMETRY
+//NOTE: this switches the debug uart to 9600 baud as well!
+#define FRSKY_HUB_PASSTHROUGH 0
+
+//reduce the telemetry tx power on a strong link (0 = always full power)
+#define FRSKY_TXPOWER_ADAPTIVE 1
+
+//rssi unit: 0 = frsky scale, 1 = dBm
+#define FRSKY_RSSI_UNIT_DBM 0
 
 //sbus or ppm out on P0_4:
 //enabling SBUS will DISABLE ppm!
@@ -10,6 +22,21 @@
 //Note: default/futaba is INVERTED=1
 //for a CC3D running OpenPilot use SBUS_INVERTED=1 !
 #define SBUS_INVERTED 1  //0 = not inverted => idle = high, 1 = INVERTED => idle = LOW
+//sbus frame period, sent by timer 1: 7000 (high speed) or 14000 (normal)
+#define SBUS_FRAME_PERIOD_US 7000
+//ppm timer reload: 1 = by dma (one interrupt per frame), 0 = by interrupt (one per pulse)
+#define PPM_USE_DMA 1
+//number of ppm channels (1..8) and sync pulse length
+#define PPM_CHANNELS 8
+#define PPM_SYNC_DURATION_US 300
+//low latency ppm: fresh channel data ends the frame gap right away (but not
+//before PPM_SYNC_GAP_MIN_US) instead of waiting for the 20ms frame to end
+#define PPM_LOW_LATENCY 0
+#define PPM_SYNC_GAP_MIN_US 3000
+//enter failsafe when there was no valid packet for this long (max 30000).
+//1500 matches the old ppm frame based guard, the connection lost check in
+//the main loop usually triggers first
+#define FAILSAFE_HOLD_MS 1500
 
 //pin layout ISP header
 #define ISP_DATA  P2_1
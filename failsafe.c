@@ -3,22 +3,23 @@
 #include "config.h"
 #include "sbus.h"
 #include "ppm.h"
+#include "timeout.h"
 
 __xdata volatile uint8_t failsafe_active;
-__xdata volatile uint16_t failsafe_tick_counter;
+__xdata uint16_t failsafe_deadline;
 
 
 void failsafe_init(void){
     debug("failsafe: init\n"); debug_flush();
-    failsafe_tick_counter = 0;
+    failsafe_deadline = timeout_time_now();
 
     //start in failsafe mode
     failsafe_enter();
 }
 
 void failsafe_exit(void){
-    //reset tick counter
-    failsafe_tick_counter = 0;
+    //valid data, push the deadline
+    failsafe_deadline = timeout_time_now() + FAILSAFE_HOLD_MS;
 
     if (failsafe_active){
         //reset failsafe counter:
@@ -34,18 +35,17 @@ void failsafe_exit(void){
     }
 }
 
-void failsafe_tick(void){
-    //this could be running during an interrupt!
-    //count missing data packets
-    failsafe_tick_counter++;
-
-    //if >1.5s no packets -> enter failsafe!
-    //actually failsafe is also entered from within frsky.c
+void failsafe_update(void){
+    //this is called from the main loop, independent of the output mode.
+    //actually failsafe is also entered from within frsky.c,
     //this is meant as a second failsafe guard
-    if (failsafe_tick_counter >= 50*9*1.5){
+    if (failsafe_active){
+        return;
+    }
+
+    //deadline passed? the signed difference handles the timebase wrap
+    if ((int16_t)(timeout_time_now() - failsafe_deadline) >= 0){
         //go to failsafe mode!
         failsafe_enter();
     }
 }
-
-
@@ -7,10 +7,14 @@
 void failsafe_init(void);
 void failsafe_enter(void);
 void failsafe_exit(void);
-void failsafe_tick(void);
+void failsafe_update(void);
 
 extern __xdata volatile uint8_t failsafe_active;
-extern __xdata volatile uint16_t failsafe_tick_counter;
+extern __xdata uint16_t failsafe_deadline;
+
+#if (FAILSAFE_HOLD_MS < 1) || (FAILSAFE_HOLD_MS > 30000)
+#error "FAILSAFE_HOLD_MS out of range (1..30000)"
+#endif
 
 #if SBUS_ENABLED
 #define failsafe_enter(){ sbus_enter_failsafe(); failsafe_active = 1; }
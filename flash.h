@@ -7,6 +7,9 @@
 extern __xdata DMA_DESC flash_dma_config;
 void flash_write(uint16_t address, uint8_t *data, uint16_t len);
 
+//page erase time, all interrupts are disabled meanwhile
+#define FLASH_ERASE_MS 20
+
 
 void flash_enable_write(void);
 void flash_erase_page(void);
@@ -28,10 +28,24 @@
 #include "apa102.h"
 #include "failsafe.h"
 #include "sbus.h"
+#include "uart.h"
+#include "flash.h"
 
 //this will make binding not very reliable, use for debugging only!
 #define FRSKY_DEBUG_BIND_DATA 0
 #define FRSKY_DEBUG_HOPTABLE 1
+//per hop debug chars and the channel stats dump. the hub passthrough
+//runs the uart at 9600 baud, this output would overflow it there
+#if FRSKY_HUB_PASSTHROUGH
+#define FRSKY_DEBUG_HOP 0
+#else
+#define FRSKY_DEBUG_HOP 1
+#endif
+#if FRSKY_DEBUG_HOP
+#define frsky_debug_hop_putc(_c) debug_putc(_c)
+#else
+#define frsky_debug_hop_putc(_c) {}
+#endif
 
 //hop data & config
 //__xdata uint8_t storage.frsky_txid[2] = {0x16, 0x68};
@@ -42,32 +56,187 @@ __xdata uint8_t frsky_current_ch_idx;
 //rssi
 __xdata uint8_t frsky_rssi;
 __xdata uint8_t frsky_link_quality;
+//rssi conversion table, indexed by the raw rssi status byte
+__code uint8_t frsky_rssi_lut[256] = {
+    FRSKY_RSSI_LUT_16(0x00), FRSKY_RSSI_LUT_16(0x10), FRSKY_RSSI_LUT_16(0x20), FRSKY_RSSI_LUT_16(0x30),
+    FRSKY_RSSI_LUT_16(0x40), FRSKY_RSSI_LUT_16(0x50), FRSKY_RSSI_LUT_16(0x60), FRSKY_RSSI_LUT_16(0x70),
+    FRSKY_RSSI_LUT_16(0x80), FRSKY_RSSI_LUT_16(0x90), FRSKY_RSSI_LUT_16(0xA0), FRSKY_RSSI_LUT_16(0xB0),
+    FRSKY_RSSI_LUT_16(0xC0), FRSKY_RSSI_LUT_16(0xD0), FRSKY_RSSI_LUT_16(0xE0), FRSKY_RSSI_LUT_16(0xF0)
+};
+//rssi filter state, rssi * 8
+__xdata uint16_t frsky_rssi_filter;
+//link quality: one bit per hop slot, set if a valid packet was received
+__xdata uint8_t frsky_lq_history[(FRSKY_LQ_WINDOW+7)/8];
+__xdata uint8_t frsky_lq_index;
+//cc2510 pa table settings: +1, 0, -2, -4, -6, -8, -10, -12 dBm
+__code uint8_t frsky_txpower_table[FRSKY_TXPOWER_LEVELS] = {
+    0xFF, 0xFE, 0xBB, 0xA9, 0x7F, 0x6E, 0x97, 0xC6
+};
+__xdata uint8_t frsky_txpower_level;
+__xdata uint8_t frsky_txpower_ticks;
 
-//pll calibration
-__xdata uint8_t frsky_calib_fscal1_table[FRSKY_HOPTABLE_SIZE];
-__xdata uint8_t frsky_calib_fscal2;
-__xdata uint8_t frsky_calib_fscal3;
 //__xdata int16_t storage.frsky_freq_offset_acc;
 
-//rf rxtx buffer
+//afc, storage.frsky_freq_offset is the offset found at bind time.
+//it is never changed by the afc, the live offset is kept separately
+__xdata int16_t frsky_afc_accum;
+__xdata uint8_t frsky_afc_count;
+__xdata int8_t frsky_afc_offset;
+__xdata int8_t frsky_afc_flash_offset;
+
+//rf tx buffer
 __xdata volatile uint8_t frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE];
-__xdata volatile uint8_t frsky_packet_received;
-__xdata volatile uint8_t frsky_packet_sent;
+//rf rx buffers, dma destination is rotated by the rf interrupt
+__xdata FRSKY_RX_BUFFER frsky_rx_buffer[FRSKY_RX_BUFFER_COUNT];
+__xdata volatile uint8_t frsky_rx_dma_idx;
+__xdata volatile uint8_t frsky_rx_ready_idx;
+__xdata volatile uint8_t frsky_rx_seq;
+__xdata volatile uint8_t frsky_rx_locked_idx;
+__xdata uint8_t frsky_rx_processed_seq;
 __xdata volatile uint8_t frsky_mode;
 
-//dma config
-__xdata DMA_DESC frsky_dma_config;
+//time spent in autotune (ms)
+__xdata uint16_t frsky_autotune_duration;
+//bind: one bit per received hop table slice
+__xdata uint16_t frsky_bind_hopdata_received;
+
+//per hop index link statistics, missed = expected packets - received.
+//packets with a bad crc are flushed by the radio and never show up here
+__xdata uint8_t frsky_chstat_received[FRSKY_HOPTABLE_SIZE];
+__xdata uint8_t frsky_chstat_rssi[FRSKY_HOPTABLE_SIZE];
+__xdata uint8_t frsky_chstat_hops;
+__xdata uint8_t frsky_chstat_cycles;
+__xdata uint8_t frsky_chstat_dump_idx;
+//selective pll recalibration, done by the hop timer
+__xdata volatile uint8_t frsky_hop_recal_idx;
+__xdata volatile uint8_t frsky_hop_recal_active;
+
+#if FRSKY_SEND_HUB_TELEMETRY
+//telemetry scheduler: hub id, interval in telemetry slots (36ms), priority.
+//a1/a2 and rssi are part of every telemetry packet anyway, rssi is
+//sent as temperature2 in addition as not all displays show the native value.
+//diagnostics counters use otherwise unused hub ids, about every 2s
+__code FRSKY_TELEMETRY_SENSOR frsky_telemetry_sensors[FRSKY_TELEMETRY_SENSOR_COUNT] = {
+    { FRSKY_HUB_TELEMETRY_CURRENT,       1, 3 },
+    { FRSKY_HUB_TELEMETRY_VOLTAGE,       4, 2 },
+    { FRSKY_HUB_TELEMETRY_FUEL,         28, 1 },
+    { FRSKY_HUB_TELEMETRY_TEMPERATURE2, 28, 0 },
+    #if FRSKY_TELEMETRY_DIAGNOSTICS
+    { FRSKY_HUB_TELEMETRY_TEMPERATURE1, 56, 0 },
+    { FRSKY_HUB_TELEMETRY_RPM,          56, 0 },
+    { FRSKY_HUB_TELEMETRY_ACCEL_X,      56, 0 },
+    { FRSKY_HUB_TELEMETRY_ACCEL_Y,      56, 0 },
+    { FRSKY_HUB_TELEMETRY_ACCEL_Z,      56, 0 },
+    { FRSKY_HUB_TELEMETRY_GPS_COURSE,   56, 0 },
+    #endif
+};
+__xdata uint8_t frsky_telemetry_sensor_due[FRSKY_TELEMETRY_SENSOR_COUNT];
+__xdata uint8_t frsky_telemetry_sensor_overdue[FRSKY_TELEMETRY_SENSOR_COUNT];
+#endif
+
+#if FRSKY_HUB_PASSTHROUGH
+//external hub sensor records
+__xdata uint8_t frsky_hub_pt_id[FRSKY_HUB_PT_SLOTS];
+__xdata uint16_t frsky_hub_pt_value[FRSKY_HUB_PT_SLOTS];
+__xdata uint16_t frsky_hub_pt_pending;
+__xdata uint8_t frsky_hub_pt_next;
+__xdata uint8_t frsky_hub_pt_record[3];
+__xdata uint8_t frsky_hub_pt_state;
+__xdata uint8_t frsky_hub_pt_escape;
+#endif
+
+#if FRSKY_SEND_HUB_TELEMETRY
+//hub telemetry stream
+__xdata uint8_t frsky_hub_buffer[FRSKY_HUB_BUFFER_SIZE];
+__xdata uint8_t frsky_hub_head;
+__xdata uint8_t frsky_hub_tail;
+__xdata uint8_t frsky_hub_tx_len;
+__xdata uint8_t frsky_hub_tx_id;
+//last byte queued is a record delimiter (0x5E)
+__xdata uint8_t frsky_hub_delimited;
+#endif
+
+//rf fifo overflow statistics
+__xdata volatile uint8_t frsky_stat_rxovf;
+__xdata volatile uint8_t frsky_stat_txunf;
+__xdata volatile uint8_t frsky_stat_txtimeout;
+__xdata volatile uint8_t frsky_stat_txskip;
+__xdata uint8_t frsky_stat_miss_streak;
+
+//hop scheduler
+__xdata volatile uint8_t frsky_hop_state;
+__xdata volatile uint8_t frsky_hop_event;
+__xdata uint8_t frsky_hop_telemetry_frame;
+__xdata volatile uint8_t frsky_hop_dwell;
+__xdata uint16_t frsky_hop_period;
+__xdata uint8_t frsky_hop_period_frac;
+__xdata uint8_t frsky_hop_frame_ticks;
+__xdata uint8_t frsky_hop_stage_ticks;
+__xdata uint8_t frsky_hop_frames_since_sync;
+__xdata int8_t frsky_hop_phase_error;
+__xdata uint8_t frsky_hop_tx_idx;
+__xdata uint8_t frsky_hop_tx_counter;
+__xdata uint8_t frsky_hop_search_window;
+__xdata volatile uint8_t frsky_conn_lost;
+__xdata volatile uint8_t frsky_telemetry_pending;
+
+//dma config for telemetry transmission, dma_config[0] is used for rx
+__xdata DMA_DESC frsky_tx_dma_config;
+//telemetry packet in frsky_packet_buffer is up to date
+__xdata volatile uint8_t frsky_telemetry_ready;
+//request id the packet was built for, and the id of the announcing packet
+__xdata uint8_t frsky_telemetry_built_id;
+__xdata volatile uint8_t frsky_telemetry_id;
 
 void frsky_init(void){
-    //uint8_t i;
+    uint8_t i;
     debug("frsky: init\n"); debug_flush();
 
     frsky_link_quality = 0;
+    for(i=0; i<sizeof(frsky_lq_history); i++){
+        frsky_lq_history[i] = 0;
+    }
+    frsky_lq_index = 0;
+
+    frsky_stat_rxovf = 0;
+    frsky_stat_txunf = 0;
+    frsky_stat_txtimeout = 0;
+    frsky_stat_txskip = 0;
+    frsky_stat_miss_streak = 0;
 
-    frsky_packet_received = 0;
-    frsky_packet_sent = 0;
+    //rx buffers
+    frsky_rx_dma_idx = 0;
+    frsky_rx_ready_idx = 0;
+    frsky_rx_locked_idx = 0xFF;
+    frsky_rx_seq = 0;
+    frsky_rx_processed_seq = 0;
 
     frsky_rssi = 100;
+    frsky_rssi_filter = 100<<3;
+
+    //frsky_configure() sets full power
+    frsky_txpower_level = 0;
+    frsky_txpower_ticks = 0;
+
+    //hub telemetry stream
+    #if FRSKY_SEND_HUB_TELEMETRY
+    frsky_telemetry_sched_init();
+    frsky_hub_head = 0;
+    frsky_hub_tail = 0;
+    frsky_hub_tx_len = 0;
+    frsky_hub_tx_id = 0;
+    frsky_hub_delimited = 0;
+    #if FRSKY_HUB_PASSTHROUGH
+    frsky_hub_passthrough_init();
+    #endif
+    #endif
+
+    //prepare hop timer
+    frsky_hop_timer_init();
+
+    //prepare rf dma descriptors
+    frsky_telemetry_ready = 0;
+    frsky_init_rf_dma();
 
     //init frsky registersttings for cc2500
     frsky_configure();
@@ -87,7 +256,7 @@ void frsky_init(void){
     //init txid matching
     frsky_configure_address();
 
-    //tune cc2500 pll and save the values to ram
+    //tune cc2500 pll (or load cached values from flash)
     frsky_calib_pll();
 
     debug("frsky: init done\n");debug_flush();
@@ -180,24 +349,373 @@ void frsky_tune_channel(uint8_t ch){
 }
 
 void frsky_rf_interrupt(void) __interrupt RF_VECTOR{
-    //clear int flag
-    RFIF &= ~(1<<4);
+    uint8_t idx;
+    uint8_t next;
+    uint8_t flags;
+
+    //fetch and clear int flags
+    flags = RFIF;
+    RFIF &= ~(RFIF_IRQ_DONE | RFIF_IRQ_RXOVF | RFIF_IRQ_TXUNF);
 
     //clear general statistics reg
     S1CON &= ~0x03;
 
+    if (flags & (RFIF_IRQ_RXOVF | RFIF_IRQ_TXUNF)){
+        //fifo overflow, the radio is stuck in this state until we go to idle
+        RFST = RFST_SIDLE;
+
+        if (flags & RFIF_IRQ_RXOVF){
+            frsky_stat_rxovf++;
+            //restart the incomplete dma transfer and go back to rx
+            DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
+            DMAARM = DMA_ARM_CH0;
+            RFST = RFST_SRX;
+        }else{
+            frsky_stat_txunf++;
+            //abort transmission
+            frsky_tx_finish();
+        }
+        return;
+    }
+
+    if (!(flags & RFIF_IRQ_DONE)){
+        //nothing else to do
+        return;
+    }
 
     if (frsky_mode == FRSKY_MODE_RX){
-        //mark as received:
-        frsky_packet_received = 1;
+        //stamp the buffer the dma just filled and mark it as the newest packet:
+        idx = frsky_rx_dma_idx;
+        frsky_rx_buffer[idx].seq = ++frsky_rx_seq;
+        frsky_rx_buffer[idx].timestamp = frsky_hop_stage_ticks + T4CNT;
+        frsky_rx_buffer[idx].freqest = FREQEST;
+        frsky_rx_buffer[idx].hop_idx = frsky_current_ch_idx;
+        frsky_rx_ready_idx = idx;
+
+        //next dma destination: neither this packet nor the one the main loop is decoding
+        next = idx;
+        do{
+            next++;
+            if (next >= FRSKY_RX_BUFFER_COUNT){
+                next = 0;
+            }
+        }while(next == frsky_rx_locked_idx);
+        frsky_rx_dma_idx = next;
+        SET_WORD(dma_config[0].DESTADDRH, dma_config[0].DESTADDRL, &frsky_rx_buffer[next].data[0]);
+
         //re arm DMA channel 0
         DMAARM = DMA_ARM_CH0;
+
+        //valid packet while the hop timer is running? -> sync hop timer
+        if ((IEN1 & IEN1_T4IE) && FRSKY_VALID_PACKET(frsky_rx_buffer[idx].data)){
+            frsky_hop_timer_sync(frsky_rx_buffer[idx].timestamp, frsky_rx_buffer[idx].data[3]);
+
+            //every 4th frame is a telemetry frame (transmits every 36ms)
+            if ((frsky_rx_buffer[idx].data[3] & 0x03) == 2){
+                //next frame is a telemetry frame, answer this request id
+                frsky_telemetry_pending = 1;
+                frsky_telemetry_id = frsky_rx_buffer[idx].data[4];
+            }
+        }
     }else{
-        frsky_packet_sent = 1;
+        //telemetry sent
+        frsky_tx_finish();
     }
 }
 
-void frsky_setup_rf_dma(uint8_t mode){
+//start the telemetry transmission of the packet in frsky_packet_buffer.
+//only call this from the hop timer isr: rx/tx switching is done by the
+//rf and hop timer isr only, they have the same priority and can not
+//interrupt each other. the main loop never touches the radio state here
+void frsky_tx_start(void){
+    //stop rx dma
+    RFST = RFST_SIDLE;
+    //abort ch0 and switch to the prepared tx descriptor
+    DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
+    SET_WORD(DMA0CFGH, DMA0CFGL, &frsky_tx_dma_config);
+    frsky_mode = FRSKY_MODE_TX;
+
+    //arm dma channel
+    RFST = RFST_STX;
+    DMAARM = DMA_ARM_CH0;
+
+    //tricky: this will force an int request and
+    //        initiate the actual transmission
+    S1CON |= 0x03;
+
+    //done. the rf isr switches back to rx when the packet was sent,
+    //the hop timer aborts the transmission if it did not finish in this frame
+}
+
+//end of telemetry transmission, switch channel 0 back to rx.
+//only call this from the rf and hop timer isr (same priority)
+void frsky_tx_finish(void){
+    RFST = RFST_SIDLE;
+    DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
+    SET_WORD(DMA0CFGH, DMA0CFGL, &dma_config[0]);
+    frsky_mode = FRSKY_MODE_RX;
+    DMAARM = DMA_ARM_CH0;
+    RFST = RFST_SRX;
+}
+
+void frsky_hop_timer_init(void){
+    //stop timer 4, no int on overflow:
+    IEN1 &= ~(IEN1_T4IE);
+    T4CTL = T4CTL_CLR;
+
+    frsky_hop_state = FRSKY_HOP_STATE_HOP;
+    frsky_hop_event = FRSKY_HOP_EVENT_NONE;
+    frsky_hop_telemetry_frame = 0;
+    frsky_hop_dwell = 0;
+    frsky_hop_period = FRSKY_HOP_PERIOD_NOMINAL;
+    frsky_hop_period_frac = 0;
+    frsky_hop_frame_ticks = FRSKY_HOP_US_TO_TICKS(FRSKY_HOP_FRAME_US);
+    frsky_hop_stage_ticks = 0;
+    frsky_hop_frames_since_sync = 0xFF;
+    frsky_hop_phase_error = 0;
+    frsky_hop_tx_idx = 0;
+    frsky_hop_tx_counter = 0;
+    frsky_hop_search_window = 0;
+    frsky_conn_lost = 1;
+    frsky_telemetry_pending = 0;
+}
+
+void frsky_hop_timer_start(void){
+    //nothing known about the tx yet, start with a full search window
+    //on the current channel
+    frsky_hop_state = FRSKY_HOP_STATE_HOP;
+    frsky_hop_tx_idx = frsky_current_ch_idx;
+    frsky_hop_search_window = FRSKY_HOP_SCAN_FRAMES;
+    frsky_hop_dwell = FRSKY_HOP_SCAN_FRAMES;
+    frsky_hop_stage_ticks = 0;
+
+    //timer 4 runs from tickspeed (set in timeout.c) /128 -> 39.38us steps
+    //count to CC0 then overflow (modulo mode)
+    T4CC0 = frsky_hop_frame_ticks - 1;
+    T4CTL = T4CTL_DIV_128 | T4CTL_CLR | T4CTL_MODE_MODULO;
+
+    //hop timing is as important as the rf int, use highest prio (same group as rf
+    //would be better but is fixed by hw) -> both can not interrupt each other
+    IP0 |= (1<<4);
+    IP1 |= (1<<4);
+
+    //clear pending ints
+    TIMIF &= ~TIMIF_T4OVFIF;
+    T4IF = 0;
+
+    //enable int and start timer
+    IEN1 |= (IEN1_T4IE);
+    T4CTL |= T4CTL_OVFIM | T4CTL_START;
+}
+
+//called by the rf interrupt for every valid packet.
+//this measures the packet arrival time against our prediction,
+//tracks the tx frame period and re-syncs the hop timer
+void frsky_hop_timer_sync(uint8_t timestamp, uint8_t counter){
+    int16_t error;
+
+    //only trust the measurement if we hopped normally since the last packet
+    //(one frame ago or two frames ago in case of a telemetry frame)
+    if ((frsky_hop_state == FRSKY_HOP_STATE_HOP) && (frsky_hop_dwell == 0) &&
+        (frsky_hop_frames_since_sync != 0) && (frsky_hop_frames_since_sync <= 2)){
+        //ticks since the last hop vs. predicted packet end (>0 = packet was late)
+        error = (int16_t)timestamp - (frsky_hop_frame_ticks - FRSKY_HOP_DELAY_TICKS);
+
+        //ignore outliers, they will only re-sync the phase
+        if ((error > -FRSKY_HOP_LOCK_WINDOW) && (error < FRSKY_HOP_LOCK_WINDOW)){
+            frsky_hop_phase_error = error;
+
+            //integrate the error into our period estimate (1/256 tick units)
+            //gain is 1/16 per frame, no mul/div in interrupt context!
+            if (frsky_hop_frames_since_sync == 1){
+                frsky_hop_period += (error << 4);
+            }else{
+                frsky_hop_period += (error << 3);
+            }
+
+            //never walk away too far from the nominal value
+            if (frsky_hop_period > FRSKY_HOP_PERIOD_NOMINAL + FRSKY_HOP_PERIOD_MAX_DEV){
+                frsky_hop_period = FRSKY_HOP_PERIOD_NOMINAL + FRSKY_HOP_PERIOD_MAX_DEV;
+            }else if (frsky_hop_period < FRSKY_HOP_PERIOD_NOMINAL - FRSKY_HOP_PERIOD_MAX_DEV){
+                frsky_hop_period = FRSKY_HOP_PERIOD_NOMINAL - FRSKY_HOP_PERIOD_MAX_DEV;
+            }
+        }
+    }
+
+    //we hop to the next channel in 0.5ms
+    //afterwards hops are in the tracked 9ms grid again
+    T4CTL |= T4CTL_CLR;
+    T4CC0 = FRSKY_HOP_DELAY_TICKS - 1;
+    TIMIF &= ~TIMIF_T4OVFIF;
+    frsky_hop_state = FRSKY_HOP_STATE_HOP;
+    frsky_hop_stage_ticks = 0;
+    frsky_hop_frames_since_sync = 0;
+    frsky_hop_dwell = 0;
+    frsky_conn_lost = 0;
+
+    //we know exactly where the tx is now
+    frsky_hop_tx_idx = frsky_current_ch_idx;
+    frsky_hop_tx_counter = counter;
+    frsky_hop_search_window = 0;
+}
+
+//called by the hop timer interrupt when we lost track of the tx.
+//we park on the channel the tx should visit in window/2 frames
+//and stay there for the full window. the window is doubled on every
+//failed try (2,4,...,FRSKY_HOP_SCAN_FRAMES) so small timing errors are
+//recovered within a few frames and the full 47 channel cycle is still
+//covered for a guaranteed (re)sync
+void frsky_hop_reacquire(void){
+    uint8_t lead;
+    uint8_t idx;
+
+    //expand search window
+    if ((frsky_hop_search_window == 0) || (frsky_hop_search_window >= FRSKY_HOP_SCAN_FRAMES)){
+        frsky_hop_search_window = 2;
+    }else{
+        frsky_hop_search_window <<= 1;
+        if (frsky_hop_search_window > FRSKY_HOP_SCAN_FRAMES){
+            frsky_hop_search_window = FRSKY_HOP_SCAN_FRAMES;
+        }
+    }
+
+    lead = frsky_hop_search_window >> 1;
+    idx  = frsky_hop_tx_idx + lead;
+    frsky_hop_dwell = frsky_hop_search_window - 1;
+
+    //every 4th frame (counter % 4 == 3) the tx listens for telemetry
+    //and does not send, wait for the frame after that instead
+    if (((uint8_t)(frsky_hop_tx_counter + lead) & 0x03) == 3){
+        idx++;
+        frsky_hop_dwell++;
+    }
+
+    if (idx >= FRSKY_HOPTABLE_SIZE){
+        idx -= FRSKY_HOPTABLE_SIZE;
+    }
+
+    frsky_current_ch_idx = idx;
+    frsky_set_channel(frsky_current_ch_idx);
+}
+
+//timer4 interrupt, this does the frequency hopping
+//in a 9ms grid that is synced/tracked by frsky_hop_timer_sync()
+void frsky_hop_timer_interrupt(void) __interrupt T4_VECTOR{
+    uint16_t tmp16;
+
+    //clear overflow flag
+    TIMIF &= ~TIMIF_T4OVFIF;
+
+    if (frsky_hop_state == FRSKY_HOP_STATE_HOP){
+        if (frsky_mode == FRSKY_MODE_TX){
+            //telemetry transmission did not finish within its frame
+            frsky_stat_txtimeout++;
+            frsky_tx_finish();
+        }
+
+        //predict the next frame: add tracked period to the fractional tick accumulator
+        tmp16 = (uint16_t)frsky_hop_period_frac + LO(frsky_hop_period);
+        frsky_hop_frame_ticks = HI(frsky_hop_period) + HI(tmp16);
+        frsky_hop_period_frac = LO(tmp16);
+        frsky_hop_stage_ticks = 0;
+
+        //count frames since last valid packet
+        if (frsky_hop_frames_since_sync != 0xFF){
+            frsky_hop_frames_since_sync++;
+        }
+
+        //the tx hops every frame, even when we do not see it.
+        //keep track of its hop index and packet counter
+        frsky_hop_tx_idx++;
+        if (frsky_hop_tx_idx >= FRSKY_HOPTABLE_SIZE){
+            frsky_hop_tx_idx = 0;
+        }
+        frsky_hop_tx_counter++;
+
+        //tell main loop about the frame that just ended
+        if (frsky_hop_telemetry_frame){
+            frsky_hop_event = FRSKY_HOP_EVENT_TELEMETRY;
+            frsky_hop_telemetry_frame = 0;
+        }else{
+            frsky_hop_event = FRSKY_HOP_EVENT_FRAME;
+        }
+
+        if (frsky_hop_dwell){
+            //searching, stay on this channel for another frame
+            frsky_hop_dwell--;
+            T4CC0 = frsky_hop_frame_ticks - 1;
+            return;
+        }
+
+        if (frsky_hop_frames_since_sync > FRSKY_HOP_TRACK_FRAMES){
+            //no packets on the predicted channels for a while, search
+            frsky_hop_reacquire();
+        }else{
+            //hop to next channel
+            frsky_increment_channel(1);
+
+            if ((frsky_current_ch_idx == frsky_hop_recal_idx) && (!frsky_telemetry_pending)){
+                //the radio idles until rx starts, calibrate the pll meanwhile
+                RFST = RFST_SCAL;
+                frsky_hop_recal_active = 1;
+            }
+        }
+
+        if (frsky_telemetry_pending){
+            //next frame is a telemetry frame, DO NOT go to SRX here
+            frsky_hop_state = FRSKY_HOP_STATE_TX;
+            frsky_hop_telemetry_frame = 1;
+            T4CC0 = FRSKY_HOP_TX_DELAY_TICKS - 1;
+        }else{
+            frsky_hop_state = FRSKY_HOP_STATE_RX;
+            T4CC0 = FRSKY_HOP_RX_DELAY_TICKS - 1;
+        }
+    }else if (frsky_hop_state == FRSKY_HOP_STATE_TX){
+        frsky_telemetry_pending = 0;
+
+        //the main loop built the packet in idle time, only the frame id
+        //is set here. start the transmission right here for an exact slot
+        //timing. if it is not ready (main loop was busy) skip this slot
+        if (frsky_telemetry_ready){
+            frsky_telemetry_ready = 0;
+            #if FRSKY_SEND_HUB_TELEMETRY
+            frsky_packet_buffer[7] = frsky_telemetry_id;
+            #endif
+            frsky_tx_start();
+        }else{
+            frsky_stat_txskip++;
+        }
+
+        frsky_hop_state = FRSKY_HOP_STATE_HOP;
+        frsky_hop_stage_ticks = FRSKY_HOP_TX_DELAY_TICKS;
+        T4CC0 = frsky_hop_frame_ticks - FRSKY_HOP_TX_DELAY_TICKS - 1;
+    }else{
+        if (frsky_hop_recal_active){
+            frsky_hop_recal_active = 0;
+            if (MARCSTATE == 0x01){
+                //calibration done, radio is idle again
+                storage_calib.fscal1_table[frsky_current_ch_idx] = FSCAL1;
+                frsky_hop_recal_idx = 0xFF;
+            }else{
+                //not done in time, abort and restore cached values. retry next cycle
+                frsky_set_channel(frsky_current_ch_idx);
+            }
+        }
+
+        //go back to rx mode, restart a dma transfer that was cut off by the hop
+        DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
+        DMAARM = DMA_ARM_CH0;
+        RFST = RFST_SRX;
+
+        frsky_hop_state = FRSKY_HOP_STATE_HOP;
+        frsky_hop_stage_ticks = FRSKY_HOP_RX_DELAY_TICKS;
+        T4CC0 = frsky_hop_frame_ticks - FRSKY_HOP_RX_DELAY_TICKS - 1;
+    }
+}
+
+//prepare the rx and tx dma descriptors for channel 0 once,
+//switching between rx and tx only changes the descriptor pointer
+void frsky_init_rf_dma(void){
     // CPU has priority over DMA
     // Use 8 bits for transfer count
     // No DMA interrupt when done
@@ -205,51 +723,80 @@ void frsky_setup_rf_dma(uint8_t mode){
     // Single transfer per trigger.
     // One byte is transferred each time.
 
+    // Receiver specific DMA settings:
+    // Source: RFD register
+    // Destination: radioPktBuffer
+    // Use the first byte read + 3 (incl. 2 status bytes)
+    // Sets maximum transfer count allowed (length byte + data + 2 status bytes)
+    // Data source address is constant
+    // Destination address is incremented by 1 byte for each write
     dma_config[0].PRIORITY       = DMA_PRI_HIGH;
     dma_config[0].M8             = DMA_M8_USE_8_BITS;
     dma_config[0].IRQMASK        = DMA_IRQMASK_DISABLE;
     dma_config[0].TRIG           = DMA_TRIG_RADIO;
     dma_config[0].TMODE          = DMA_TMODE_SINGLE;
     dma_config[0].WORDSIZE       = DMA_WORDSIZE_BYTE;
+    SET_WORD(dma_config[0].SRCADDRH, dma_config[0].SRCADDRL, &X_RFD);
+    SET_WORD(dma_config[0].DESTADDRH, dma_config[0].DESTADDRL, &frsky_rx_buffer[frsky_rx_dma_idx].data[0]);
+    dma_config[0].VLEN           = DMA_VLEN_FIRST_BYTE_P_3;
+    SET_WORD(dma_config[0].LENH, dma_config[0].LENL, (FRSKY_PACKET_LENGTH+3));
+    dma_config[0].SRCINC         = DMA_SRCINC_0;
+    dma_config[0].DESTINC        = DMA_DESTINC_1;
+
+    // Transmitter specific DMA settings
+    // Source: radioPktBuffer
+    // Destination: RFD register
+    // Use the first byte read + 1
+    // Sets the maximum transfer count allowed (length byte + data)
+    // Data source address is incremented by 1 byte
+    // Destination address is constant
+    frsky_tx_dma_config.PRIORITY = DMA_PRI_HIGH;
+    frsky_tx_dma_config.M8       = DMA_M8_USE_8_BITS;
+    frsky_tx_dma_config.IRQMASK  = DMA_IRQMASK_DISABLE;
+    frsky_tx_dma_config.TRIG     = DMA_TRIG_RADIO;
+    frsky_tx_dma_config.TMODE    = DMA_TMODE_SINGLE;
+    frsky_tx_dma_config.WORDSIZE = DMA_WORDSIZE_BYTE;
+    SET_WORD(frsky_tx_dma_config.SRCADDRH, frsky_tx_dma_config.SRCADDRL, frsky_packet_buffer);
+    SET_WORD(frsky_tx_dma_config.DESTADDRH, frsky_tx_dma_config.DESTADDRL, &X_RFD);
+    frsky_tx_dma_config.VLEN     = DMA_VLEN_FIRST_BYTE_P_1;
+    SET_WORD(frsky_tx_dma_config.LENH, frsky_tx_dma_config.LENL, (FRSKY_PACKET_LENGTH+1));
+    frsky_tx_dma_config.SRCINC   = DMA_SRCINC_1;
+    frsky_tx_dma_config.DESTINC  = DMA_DESTINC_0;
+}
 
+void frsky_setup_rf_dma(uint8_t mode){
     //store mode
     frsky_mode = mode;
 
+    // Save pointer to the DMA configuration struct into DMA-channel 0
+    // configuration registers
     if (frsky_mode == FRSKY_MODE_TX) {
-        // Transmitter specific DMA settings
-        // Source: radioPktBuffer
-        // Destination: RFD register
-        // Use the first byte read + 1
-        // Sets the maximum transfer count allowed (length byte + data)
-        // Data source address is incremented by 1 byte
-        // Destination address is constant
-        SET_WORD(dma_config[0].SRCADDRH, dma_config[0].SRCADDRL, frsky_packet_buffer);
-        SET_WORD(dma_config[0].DESTADDRH, dma_config[0].DESTADDRL, &X_RFD);
-        dma_config[0].VLEN           = DMA_VLEN_FIRST_BYTE_P_1;
-        SET_WORD(dma_config[0].LENH, dma_config[0].LENL, (FRSKY_PACKET_LENGTH+1));
-        dma_config[0].SRCINC         = DMA_SRCINC_1;
-        dma_config[0].DESTINC        = DMA_DESTINC_0;
+        SET_WORD(DMA0CFGH, DMA0CFGL, &frsky_tx_dma_config);
     }else{
-        // Receiver specific DMA settings:
-        // Source: RFD register
-        // Destination: radioPktBuffer
-        // Use the first byte read + 3 (incl. 2 status bytes)
-        // Sets maximum transfer count allowed (length byte + data + 2 status bytes)
-        // Data source address is constant
-        // Destination address is incremented by 1 byte for each write
-        SET_WORD(dma_config[0].SRCADDRH, dma_config[0].SRCADDRL, &X_RFD);
-        SET_WORD(dma_config[0].DESTADDRH, dma_config[0].DESTADDRL, &frsky_packet_buffer[0]);
-        dma_config[0].VLEN           = DMA_VLEN_FIRST_BYTE_P_3;
-        SET_WORD(dma_config[0].LENH, dma_config[0].LENL, (FRSKY_PACKET_LENGTH+3));
-        dma_config[0].SRCINC         = DMA_SRCINC_0;
-        dma_config[0].DESTINC        = DMA_DESTINC_1;
+        SET_WORD(DMA0CFGH, DMA0CFGL, &dma_config[0]);
     }
+}
 
-    // Save pointer to the DMA configuration struct into DMA-channel 0
-    // configuration registers
-    SET_WORD(DMA0CFGH, DMA0CFGL, &dma_config[0]);
+//fetch the newest received packet (or 0 if there is none)
+//the returned buffer will not be touched by the dma until the next call
+__xdata uint8_t *frsky_rx_fetch(void){
+    uint8_t idx;
 
-    frsky_packet_received = 0;
+    if (frsky_rx_seq == frsky_rx_processed_seq){
+        //nothing new
+        return 0;
+    }
+
+    //lock the newest buffer, the rf int must not change it in between
+    cli();
+    idx = frsky_rx_ready_idx;
+    frsky_rx_locked_idx = idx;
+    sei();
+
+    //in case we were too slow this skips older packets
+    frsky_rx_processed_seq = frsky_rx_buffer[idx].seq;
+
+    return &frsky_rx_buffer[idx].data[0];
 }
 
 void frsky_enter_rxmode(uint8_t channel){
@@ -265,8 +812,8 @@ void frsky_enter_rxmode(uint8_t channel){
     IP0 |= (1<<0);
     IP1 |= (1<<0);
 
-    //mask done irq
-    RFIM = (1<<4);
+    //unmask done and fifo overflow irqs
+    RFIM = RFIM_IM_DONE | RFIM_IM_RXOVF | RFIM_IM_TXUNF;
     //interrupts should be enabled globally already..
     //skip this! sei();
 
@@ -280,33 +827,126 @@ void frsky_enter_rxmode(uint8_t channel){
     RFST = RFST_SRX;
 }
 
-void frsky_autotune(void){
-    uint8_t done = 0;
+//apply a new frequency offset and restart rx
+void frsky_autotune_set_offset(int8_t offset){
+    storage.frsky_freq_offset = offset;
+
+    //go to idle
+    RFST = RFST_SIDLE;
+    //set freq offset
+    FSCTRL0 = storage.frsky_freq_offset;
+    //go back to RX, restart a dma transfer that was cut off by the idle strobe:
+    delay_ms(1);
+    DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
+    DMAARM = DMA_ARM_CH0;
+    RFST = RFST_SRX;
+
+    //drop packets received with the old offset
+    frsky_rx_processed_seq = frsky_rx_seq;
+}
+
+//wait for a valid bind packet, returns 0 on timeout.
+//the time spent waiting is accumulated in frsky_autotune_duration
+__xdata uint8_t *frsky_autotune_wait_bind_packet(uint16_t timeout_ms){
+    __xdata uint8_t *packet;
+    uint16_t remaining;
+
+    timeout_set(timeout_ms);
+
+    while(1){
+        //reset wdt
+        wdt_reset();
+
+        packet = frsky_rx_fetch();
+        if ((packet) && FRSKY_VALID_PACKET_BIND(packet)){
+            //collect txid and hop table while tuning
+            frsky_bind_harvest(packet);
+            break;
+        }
+
+        if (timeout_timed_out()){
+            packet = 0;
+            break;
+        }
+    }
+
+    //update duration
+    cli();
+    remaining = timeout_countdown;
+    sei();
+    frsky_autotune_duration += 1 + timeout_ms - remaining;
+
+    return packet;
+}
+
+//fast autotune: the demodulator estimates the frequency offset of every
+//received packet (FREQEST, same resolution as FSCTRL0). add it to our offset
+//until the estimate stays close to zero. returns 0 if there was no convergence
+uint8_t frsky_autotune_freqest(void){
+    uint8_t packets = 0;
+    uint8_t locked = 0;
+    int8_t freqest;
+    int16_t offset;
+
+    debug("frsky: autotune (freqest)\n"); debug_flush();
+
+    frsky_autotune_set_offset(0);
+
+    while(packets < FRSKY_AUTOTUNE_FREQEST_MAX_PACKETS){
+        if (!frsky_autotune_wait_bind_packet(FRSKY_AUTOTUNE_FREQEST_TIMEOUT)){
+            //no bind packet received, offset might be too far off
+            debug_putc('-');
+            return 0;
+        }
+        packets++;
+
+        //estimate for this packet, captured by the rf isr
+        freqest = frsky_rx_buffer[frsky_rx_locked_idx].freqest;
+
+        debug_putc('B');
+
+        if ((freqest >= -FRSKY_AUTOTUNE_FREQEST_TOLERANCE) && (freqest <= FRSKY_AUTOTUNE_FREQEST_TOLERANCE)){
+            //close enough, require a few consecutive hits
+            locked++;
+            if (locked >= FRSKY_AUTOTUNE_FREQEST_LOCK_PACKETS){
+                debug_put_newline();
+                return 1;
+            }
+        }else{
+            locked = 0;
+
+            //apply correction
+            offset = storage.frsky_freq_offset + freqest;
+            if (offset > 127){
+                offset = 127;
+            }else if (offset < -127){
+                offset = -127;
+            }
+            frsky_autotune_set_offset(offset);
+        }
+    }
+
+    debug_put_newline();
+    return 0;
+}
+
+//slow autotune: sweep the full offset range and center on the window
+//where bind packets were received
+void frsky_autotune_sweep(void){
     uint8_t received_packet = 0;
     uint8_t state = 0;
+    int8_t offset = 0;
     int8_t fscal0_min=127;
     int8_t fscal0_max=-127;
     int16_t fscal0_calc;
 
-    debug("frsky: autotune\n"); debug_flush();
-
-
-    //enter RX mode
-    frsky_enter_rxmode(0);
-
-    //find best offset:
-    storage.frsky_freq_offset = 0;
-
-    debug("frsky: entering bind loop\n"); debug_flush();
+    debug("frsky: autotune (sweep)\n"); debug_flush();
 
     //search for best fscal 0 match
     while(state != 5){
         //reset wdt
         wdt_reset();
 
-        //handle any ovf conditions
-        frsky_handle_overflows();
-
         //debug_put_uint8(state);
 
         //search full range quickly using binary search
@@ -314,19 +954,19 @@ void frsky_autotune(void){
             default:
             case(0):
                 //init left search:
-                storage.frsky_freq_offset = -127;
+                offset = -127;
                 state = 1;
                 break;
 
             case(1):
                 //first search quickly through the full range:
-                if (storage.frsky_freq_offset < 127-10){
-                    storage.frsky_freq_offset += 9;
+                if (offset < 127-10){
+                    offset += 9;
                 }else{
                     //done one search, did we receive anything?
                     if (received_packet){
                         //finished, go to slow search
-                        storage.frsky_freq_offset = fscal0_min - 9;
+                        offset = fscal0_min - 9;
                         state = 2;
                     }else{
                         //no success, lets try again
@@ -336,8 +976,8 @@ void frsky_autotune(void){
                 break;
 
             case(2):
-                if (storage.frsky_freq_offset < fscal0_max+9){
-                    storage.frsky_freq_offset++;
+                if (offset < fscal0_max+9){
+                    offset++;
                 }else{
                     //done!
                     state = 5;
@@ -345,62 +985,24 @@ void frsky_autotune(void){
                 break;
         }
 
-        //go to idle
-        RFST = RFST_SIDLE;
-        //set freq offset
-        FSCTRL0 = storage.frsky_freq_offset;
-        //go back to RX:
-        delay_ms(1);
-        RFST = RFST_SRX;
-
-        //set timeout
-        timeout_set(50);
-        done = 0;
+        frsky_autotune_set_offset(offset);
 
         LED_GREEN_ON();
         LED_RED_OFF();
 
         //debug("tune "); debug_put_int8(storage.frsky_freq_offset); debug_put_newline(); debug_flush();
 
-        while((!timeout_timed_out()) && (!done)){
-            //handle any ovf conditions
-            frsky_handle_overflows();
-
-            if (frsky_packet_received){
-                //prepare for next packet:
-                frsky_packet_received = 0;
-                DMAARM = DMA_ARM_CH0;
-                RFST = RFST_SRX;
-
-                //valid packet?
-                if (FRSKY_VALID_PACKET_BIND(frsky_packet_buffer)){
-                    //bind packet!
-                    debug_putc('B');
+        if (frsky_autotune_wait_bind_packet(50)){
+            //bind packet!
+            debug_putc('B');
 
-                    //packet received
-                    received_packet = 1;
-
-                    //this fscal value is done
-                    done = 1;
-
-                    //update min/max
-                    fscal0_min = min(fscal0_min, storage.frsky_freq_offset);
-                    fscal0_max = max(fscal0_max, storage.frsky_freq_offset);
-
-                    //make sure we never read the same packet twice by crc flag
-                    frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE-1] = 0x00;
-                }
+            //packet received
+            received_packet = 1;
 
-                /*debug("[");debug_flush();
-                for(cnt=0; cnt<FRSKY_PACKET_BUFFER_SIZE; cnt++){
-                    debug_hex8(frsky_packet_buffer[cnt]);
-                    debug_putc(' ');
-                    debug_flush();
-                }
-                debug("]\n"); debug_flush();*/
-            }
-        }
-        if (!done){
+            //update min/max
+            fscal0_min = min(fscal0_min, offset);
+            fscal0_max = max(fscal0_max, offset);
+        }else{
             debug_putc('-');
         }
     }
@@ -416,18 +1018,29 @@ void frsky_autotune(void){
     debug_flush();
 
     //store new value
-    storage.frsky_freq_offset = fscal0_calc;
+    frsky_autotune_set_offset(fscal0_calc);
+}
 
-    RFST = RFST_SIDLE;
-    //set freq offset
-    FSCTRL0 = storage.frsky_freq_offset;
-    //go back to RX:
-    delay_ms(1);
-    RFST = RFST_SRX;
+void frsky_autotune(void){
+    debug("frsky: autotune\n"); debug_flush();
+
+    frsky_autotune_duration = 0;
+
+    //enter RX mode
+    frsky_enter_rxmode(0);
+
+    debug("frsky: entering bind loop\n"); debug_flush();
+
+    //try the fast way first, fall back to a full sweep
+    if (!frsky_autotune_freqest()){
+        frsky_autotune_sweep();
+    }
 
     debug("frsky: autotune done. offset=");
     debug_put_int8(storage.frsky_freq_offset);
-    debug_put_newline();
+    debug(" time=");
+    debug_put_uint16(frsky_autotune_duration);
+    debug("ms\n");
     debug_flush();
 }
 
@@ -445,7 +1058,10 @@ uint8_t frsky_bind_jumper_set(void){
 
 
 void frsky_do_bind(void){
+    uint16_t bind_start;
+
     debug("frsky: do bind\n"); debug_flush();
+    bind_start = timeout_time_now();
 
     //set txid to bind channel
     storage.frsky_txid[0] = 0x03;
@@ -456,6 +1072,12 @@ void frsky_do_bind(void){
     //init txid matching
     frsky_configure_address();
 
+    //address filter is set up, clear txid. bind packets will fill in
+    //txid and hop table from now on
+    storage.frsky_txid[0] = 0;
+    storage.frsky_txid[1] = 0;
+    frsky_bind_hopdata_received = 0;
+
     //set up leds:frsky_txid
     LED_RED_ON();
     LED_GREEN_ON();
@@ -463,9 +1085,19 @@ void frsky_do_bind(void){
     //start autotune:
     frsky_autotune();
 
-    //now run the actual binding:
+    debug("frsky: hop table slices from autotune 0x");
+    debug_put_hex8(HI(frsky_bind_hopdata_received));
+    debug_put_hex8(LO(frsky_bind_hopdata_received));
+    debug_put_newline();
+
+    //now fetch the remaining hop table slices:
     frsky_fetch_txid_and_hoptable();
 
+    debug("frsky: bind done. time=");
+    debug_put_uint16(timeout_time_now() - bind_start);
+    debug("ms\n");
+    debug_flush();
+
     //important: stop RF interrupts:
     IEN2 &= ~(IEN2_RFIE);
     RFIM = 0;
@@ -487,43 +1119,60 @@ void frsky_do_bind(void){
 }
 
 
-void frsky_handle_overflows(void){
-    if ((MARCSTATE & 0x1F) == 0x11){
-        debug("frsky: RXOVF\n");
-        RFST = RFST_SIDLE;
-    }else if ((MARCSTATE & 0x1F) == 0x16){
-        debug("frsky: TXOVF\n");
-        RFST = RFST_SIDLE;
+//extract txid and hop table slice from a valid bind packet
+void frsky_bind_harvest(__xdata uint8_t *packet){
+    uint8_t index;
+    uint8_t i;
+
+    //do we know our txid yet?
+    if ((storage.frsky_txid[0] == 0) && (storage.frsky_txid[1] == 0)){
+        //no! extract this
+        storage.frsky_txid[0] = packet[3];
+        storage.frsky_txid[1] = packet[4];
+        //debug
+        debug("frsky: got txid 0x");
+        debug_put_hex8(storage.frsky_txid[0]);
+        debug_put_hex8(storage.frsky_txid[1]);
+        debug_put_newline();
+    }
+
+    //this is actually for us
+    index = packet[5];
+
+    //valid bind index?
+    if (index/5 < FRSKY_BIND_PACKET_COUNT){
+        //copy data to our hop list:
+        for(i=0; i<5; i++){
+            if ((index+i) < FRSKY_HOPTABLE_SIZE){
+                storage.frsky_hop_table[index+i] = packet[6+i];
+            }
+        }
+        //mark as done: set bit flag for index
+        frsky_bind_hopdata_received |= (1<<(index/5));
+    }else{
+        debug("frsky: invalid bind idx");
+        debug_put_uint8(index/5);
+        debug_put_newline();
     }
 }
 
 void frsky_fetch_txid_and_hoptable(void){
-    uint16_t hopdata_received = 0;
-    uint8_t index;
+    __xdata uint8_t *packet;
+    #if FRSKY_DEBUG_BIND_DATA
     uint8_t i;
+    #endif
 
     //enter RX mode
     frsky_enter_rxmode(0);
 
-    #define MAX_BIND_PACKET_COUNT 10
-    //DONE when n times a one:
-    #define HOPDATA_RECEIVE_DONE ((1<<(MAX_BIND_PACKET_COUNT))-1)
-
-    //clear txid:
-    storage.frsky_txid[0] = 0;
-    storage.frsky_txid[1] = 0;
-
     //timeout to wait for packets
     timeout_set(9*3+1);
 
-    //fetch hopdata array
-    while(hopdata_received != HOPDATA_RECEIVE_DONE){
+    //fetch missing hopdata, autotune harvested some of it already
+    while(frsky_bind_hopdata_received != FRSKY_BIND_HOPDATA_DONE){
         //reset wdt
         wdt_reset();
 
-        //handle any ovf conditions
-        frsky_handle_overflows();
-
         //FIXME: this should be handled in a cleaner way.
         //as this is just for binding, stay with this fix for now...
         if (timeout_timed_out()){
@@ -536,26 +1185,22 @@ void frsky_fetch_txid_and_hoptable(void){
             //re-prepare for next packet:
             RFST = RFST_SIDLE;
             delay_ms(1);
-            frsky_packet_received = 0;
+            DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
             DMAARM = DMA_ARM_CH0;
             RFST = RFST_SRX;
         }
 
-        if (frsky_packet_received){
+        packet = frsky_rx_fetch();
+        if (packet){
             debug_putc('p');
 
-            //prepare for next packet:
-            frsky_packet_received = 0;
-            DMAARM = DMA_ARM_CH0;
-            RFST = RFST_SRX;
-
 
             #if FRSKY_DEBUG_BIND_DATA
-            if (FRSKY_VALID_FRAMELENGTH(frsky_packet_buffer)){
+            if (FRSKY_VALID_FRAMELENGTH(packet)){
                 debug("frsky: RX ");
                 debug_flush();
                 for(i=0; i<FRSKY_PACKET_BUFFER_SIZE; i++){
-                    debug_put_hex8(frsky_packet_buffer[i]);
+                    debug_put_hex8(packet[i]);
                     debug_putc(' ');
                 }
                 debug_put_newline();
@@ -563,45 +1208,13 @@ void frsky_fetch_txid_and_hoptable(void){
             #endif
 
 
-            //do we know our txid yet?
-            if (FRSKY_VALID_PACKET_BIND(frsky_packet_buffer)){
+            if (FRSKY_VALID_PACKET_BIND(packet)){
                 //next packet should be ther ein 9ms
                 //if no packet for 3*9ms -> reset rx chain:
                 timeout_set(3*9+1);
 
                 debug_putc('B');
-                if ((storage.frsky_txid[0] == 0) && (storage.frsky_txid[1] == 0)){
-                    //no! extract this
-                    storage.frsky_txid[0] = frsky_packet_buffer[3];
-                    storage.frsky_txid[1] = frsky_packet_buffer[4];
-                    //debug
-                    debug("frsky: got txid 0x");
-                    debug_put_hex8(storage.frsky_txid[0]);
-                    debug_put_hex8(storage.frsky_txid[1]);
-                    debug_put_newline();
-                }
-
-                //this is actually for us
-                index = frsky_packet_buffer[5];
-
-                //valid bind index?
-                if (index/5 < MAX_BIND_PACKET_COUNT){
-                    //copy data to our hop list:
-                    for(i=0; i<5; i++){
-                        if ((index+i) < FRSKY_HOPTABLE_SIZE){
-                            storage.frsky_hop_table[index+i] = frsky_packet_buffer[6+i];
-                        }
-                    }
-                    //mark as done: set bit flag for index
-                    hopdata_received |= (1<<(index/5));
-                }else{
-                    debug("frsky: invalid bind idx");
-                    debug_put_uint8(index/5);
-                    debug_put_newline();
-                }
-
-                //make sure we never read the same packet twice by crc flag
-                frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE-1] = 0x00;
+                frsky_bind_harvest(packet);
             }
         }
     }
@@ -620,12 +1233,43 @@ void frsky_fetch_txid_and_hoptable(void){
     RFST = RFST_SIDLE;
 }
 
-void frsky_calib_pll(void){
-    uint8_t i;
-    uint8_t ch;
+//check if the pll calibration stored on flash can be used
+uint8_t frsky_calib_cache_check(uint16_t temperature){
+    if ((storage_calib.version != STORAGE_CALIB_VERSION_ID) ||
+        (storage_calib.txid[0] != storage.frsky_txid[0]) ||
+        (storage_calib.txid[1] != storage.frsky_txid[1]) ||
+        (storage_calib.freq_offset != storage.frsky_freq_offset)){
+        return FRSKY_CALIB_CACHE_INVALID;
+    }
+
+    if ((temperature + FRSKY_CALIB_TEMPERATURE_TOLERANCE < storage_calib.temperature) ||
+        (temperature > storage_calib.temperature + FRSKY_CALIB_TEMPERATURE_TOLERANCE)){
+        return FRSKY_CALIB_CACHE_TEMPERATURE;
+    }
+
+    return FRSKY_CALIB_CACHE_VALID;
+}
+
+void frsky_calib_pll(void){
+    uint8_t i;
+    uint8_t ch;
+    uint8_t cache;
+    uint16_t temperature;
 
     debug("frsky: calib pll\n");
 
+    //cached calibration for this setup?
+    temperature = adc_get_temperature();
+    debug("frsky: temperature ");
+    debug_put_uint16(temperature);
+    debug_put_newline();
+
+    cache = frsky_calib_cache_check(temperature);
+    if (cache == FRSKY_CALIB_CACHE_VALID){
+        debug("frsky: using cached pll calib\n");
+        return;
+    }
+
     //fine tune offset
     FSCTRL0 = storage.frsky_freq_offset;
 
@@ -647,30 +1291,46 @@ void frsky_calib_pll(void){
         frsky_tune_channel(ch);
 
         //store pll calibration:
-        frsky_calib_fscal1_table[i] = FSCAL1;
+        storage_calib.fscal1_table[i] = FSCAL1;
     }
     debug_put_newline();
 
     //only needed once:
-    frsky_calib_fscal3 = FSCAL3;
-    frsky_calib_fscal2 = FSCAL2;
+    storage_calib.fscal3 = FSCAL3;
+    storage_calib.fscal2 = FSCAL2;
 
     //return to idle
     RFST = RFST_SIDLE;
 
     debug("frsky: calib fscal1 = ");
     for(i=0; i<FRSKY_HOPTABLE_SIZE; i++){
-        debug_put_hex8(frsky_calib_fscal1_table[i]);
+        debug_put_hex8(storage_calib.fscal1_table[i]);
         debug_putc(' ');
         debug_flush();
     }
     debug("\nfrsky: calib fscal2 = 0x");
-    debug_put_hex8(frsky_calib_fscal2);
+    debug_put_hex8(storage_calib.fscal2);
     debug("\nfrsky: calib fscal3 = 0x");
-    debug_put_hex8(frsky_calib_fscal3);
+    debug_put_hex8(storage_calib.fscal3);
     debug_put_newline();
     debug_flush();
 
+    //only a new txid or offset is persisted. a temperature change alone
+    //is handled in ram, this keeps flash writes at boot rare
+    if (cache == FRSKY_CALIB_CACHE_INVALID){
+        //update cache. nothing else uses dma yet, we can write the flash now
+        storage_calib.txid[0] = storage.frsky_txid[0];
+        storage_calib.txid[1] = storage.frsky_txid[1];
+        storage_calib.freq_offset = storage.frsky_freq_offset;
+        storage_calib.temperature = temperature;
+        storage_calib.afc_offset = storage.frsky_freq_offset;
+        storage_calib_write_to_flash();
+    }else{
+        //the ram copy matches this temperature now, keep it consistent
+        //in case the afc persists the calib page later on
+        storage_calib.temperature = temperature;
+    }
+
     debug("frsky: calib pll done\n");
 }
 
@@ -683,103 +1343,489 @@ void frsky_set_channel(uint8_t hop_index){
     RFST = RFST_SIDLE;
 
     //fetch and set our stored pll calib data:
-    FSCAL3 = frsky_calib_fscal3;
-    FSCAL2 = frsky_calib_fscal2;
-    FSCAL1 = frsky_calib_fscal1_table[hop_index];
+    FSCAL3 = storage_calib.fscal3;
+    FSCAL2 = storage_calib.fscal2;
+    FSCAL1 = storage_calib.fscal1_table[hop_index];
 
     //set channel
     CHANNR = ch;
 }
 
 
+void frsky_afc_init(void){
+    frsky_afc_accum = 0;
+    frsky_afc_count = 0;
+
+    //start with the offset learned in the last flight if the calib page
+    //belongs to this binding, otherwise with the bind time offset
+    frsky_afc_offset = storage.frsky_freq_offset;
+    if (frsky_calib_cache_check(storage_calib.temperature) != FRSKY_CALIB_CACHE_INVALID){
+        frsky_afc_offset = frsky_afc_clamp(storage_calib.afc_offset);
+    }
+    frsky_afc_flash_offset = frsky_afc_offset;
+
+    FSCTRL0 = frsky_afc_offset;
+}
+
+//limit an offset to the allowed afc range around the bind time offset
+int8_t frsky_afc_clamp(int16_t offset){
+    int16_t min = (int16_t)storage.frsky_freq_offset - FRSKY_AFC_MAX_DEVIATION;
+    int16_t max = (int16_t)storage.frsky_freq_offset + FRSKY_AFC_MAX_DEVIATION;
+
+    if (offset < min){
+        return (min < -127) ? -127 : min;
+    }
+    if (offset > max){
+        return (max > 127) ? 127 : max;
+    }
+    return (int8_t)offset;
+}
+
+//background frequency offset compensation, called for every valid packet.
+//averages the demodulator offset estimate and trims FSCTRL0 by one step
+//(1.6kHz) at most every FRSKY_AFC_PACKETS packets
+void frsky_afc_update(int8_t freqest){
+    int16_t mean;
+    int8_t offset;
+
+    frsky_afc_accum += freqest;
+    frsky_afc_count++;
+
+    if (frsky_afc_count < FRSKY_AFC_PACKETS){
+        return;
+    }
+
+    //average estimate, |mean| < 1 step rounds to zero -> no change
+    mean = frsky_afc_accum / FRSKY_AFC_PACKETS;
+    frsky_afc_accum = 0;
+    frsky_afc_count = 0;
+
+    //the range is centred on the bind time offset, the learned offset
+    //can never walk away from it over several flights
+    if (mean > 0){
+        offset = frsky_afc_clamp(frsky_afc_offset + 1);
+    }else if (mean < 0){
+        offset = frsky_afc_clamp(frsky_afc_offset - 1);
+    }else{
+        //nothing to do
+        return;
+    }
+
+    frsky_afc_offset = offset;
+
+    //new offset is used from the next rx start on
+    FSCTRL0 = frsky_afc_offset;
+}
+
+//persist the learned offset in the calib page, the bind page is never touched.
+//a flash write stalls the cpu and kills all dma transfers, only call this
+//when the link is down for a while
+void frsky_afc_store(void){
+    uint16_t start;
+    uint8_t frames;
+
+    if ((frsky_afc_offset >= frsky_afc_flash_offset - FRSKY_AFC_STORE_THRESHOLD) &&
+        (frsky_afc_offset <= frsky_afc_flash_offset + FRSKY_AFC_STORE_THRESHOLD)){
+        //not worth a flash write
+        return;
+    }
+
+    debug("frsky: afc store offset ");
+    debug_put_int8(frsky_afc_offset);
+    debug_put_newline();
+
+    //pause hopping and rf interrupts, the hop timer state is kept
+    IEN1 &= ~(IEN1_T4IE);
+    IEN2 &= ~(IEN2_RFIE);
+    RFST = RFST_SIDLE;
+    start = timeout_time_now();
+
+    storage_calib.afc_offset = frsky_afc_offset;
+    storage_calib_write_to_flash();
+    frsky_afc_flash_offset = frsky_afc_offset;
+
+    //the tx kept hopping meanwhile, move our dead reckoned tx position along.
+    //the ms timebase stood still during the page erase, add that time
+    frames = ((uint32_t)(timeout_time_now() - start + FLASH_ERASE_MS) * 1000) / FRSKY_HOP_FRAME_US;
+    while(frames--){
+        frsky_hop_tx_idx++;
+        if (frsky_hop_tx_idx >= FRSKY_HOPTABLE_SIZE){
+            frsky_hop_tx_idx = 0;
+        }
+        frsky_hop_tx_counter++;
+    }
+
+    //flash write aborted all dma transfers and reused dma channel 0
+    adc_arm_dma();
+    frsky_enter_rxmode(storage.frsky_hop_table[frsky_current_ch_idx]);
+
+    //continue the search on the current schedule
+    TIMIF &= ~TIMIF_T4OVFIF;
+    IEN1 |= (IEN1_T4IE);
+}
+
+void frsky_chstat_init(void){
+    uint8_t i;
+
+    for(i=0; i<FRSKY_HOPTABLE_SIZE; i++){
+        frsky_chstat_received[i] = 0;
+        frsky_chstat_rssi[i] = 0;
+    }
+    frsky_chstat_hops = 0;
+    frsky_chstat_cycles = 0;
+    frsky_chstat_dump_idx = FRSKY_CHSTAT_DUMP_DONE;
+    frsky_hop_recal_idx = 0xFF;
+    frsky_hop_recal_active = 0;
+}
+
+//account a valid packet to its hop index
+void frsky_chstat_packet(uint8_t hop_idx, __xdata uint8_t *packet){
+    if ((frsky_conn_lost) || (hop_idx >= FRSKY_HOPTABLE_SIZE)){
+        return;
+    }
+
+    if (FRSKY_VALID_PACKET(packet)){
+        frsky_chstat_received[hop_idx]++;
+        //rssi average, 1/8 weight for the new value
+        frsky_chstat_rssi[hop_idx] = (((uint16_t)frsky_chstat_rssi[hop_idx]) * 7
+                                      + frsky_extract_rssi(packet[FRSKY_PACKET_BUFFER_SIZE-2])) >> 3;
+    }
+}
+
+//called for every hop, counts full hop table cycles while connected
+void frsky_chstat_hop(void){
+    if (frsky_chstat_dump_idx != FRSKY_CHSTAT_DUMP_DONE){
+        //print one channel per hop, keeps the main loop responsive
+        frsky_chstat_dump();
+    }
+
+    if (frsky_conn_lost){
+        return;
+    }
+
+    frsky_chstat_hops++;
+    if (frsky_chstat_hops < FRSKY_HOPTABLE_SIZE){
+        return;
+    }
+    frsky_chstat_hops = 0;
+    frsky_chstat_cycles++;
+
+    if ((frsky_chstat_cycles >= FRSKY_CHSTAT_WINDOW) && (frsky_chstat_dump_idx == FRSKY_CHSTAT_DUMP_DONE)){
+        frsky_chstat_evaluate();
+    }
+}
+
+//look for a channel with significantly more losses than the others
+void frsky_chstat_evaluate(void){
+    uint8_t i;
+    uint8_t loss;
+    uint8_t worst_loss = 0;
+    uint8_t worst_idx = 0;
+    uint16_t loss_sum = 0;
+    uint8_t expected = FRSKY_CHSTAT_EXPECTED(frsky_chstat_cycles);
+
+    for(i=0; i<FRSKY_HOPTABLE_SIZE; i++){
+        loss = expected - min(expected, frsky_chstat_received[i]);
+        loss_sum += loss;
+        if (loss > worst_loss){
+            worst_loss = loss;
+            worst_idx = i;
+        }
+    }
+
+    debug("frsky: chstat worst idx ");
+    debug_put_uint8(worst_idx);
+    debug(" loss ");
+    debug_put_uint8(worst_loss);
+    debug("/");
+    debug_put_uint8(expected);
+    debug_put_newline();
+
+    if (worst_loss > 2 * (loss_sum / FRSKY_HOPTABLE_SIZE) + FRSKY_CHSTAT_RECAL_MARGIN){
+        //let the hop timer recalibrate this one
+        debug("frsky: recalibrating idx ");
+        debug_put_uint8(worst_idx);
+        debug_put_newline();
+        frsky_hop_recal_idx = worst_idx;
+    }
+
+    //dump histogram, counters are halved when this is done.
+    //the next evaluation is FRSKY_CHSTAT_WINDOW/2 cycles from now
+    #if FRSKY_DEBUG_HOP
+    frsky_chstat_dump_idx = 0;
+    #else
+    //no dump, just age the counters on the next hop
+    frsky_chstat_dump_idx = FRSKY_HOPTABLE_SIZE;
+    #endif
+}
+
+//print stats for one hop index: idx ch received missed rssi
+void frsky_chstat_dump(void){
+    uint8_t i = frsky_chstat_dump_idx;
+    uint8_t lost;
+    uint8_t expected;
+
+    if (i >= FRSKY_HOPTABLE_SIZE){
+        //dump done, age all counters
+        for(i=0; i<FRSKY_HOPTABLE_SIZE; i++){
+            frsky_chstat_received[i] >>= 1;
+        }
+        frsky_chstat_cycles >>= 1;
+        frsky_chstat_dump_idx = FRSKY_CHSTAT_DUMP_DONE;
+        return;
+    }
+
+    expected = FRSKY_CHSTAT_EXPECTED(frsky_chstat_cycles);
+    lost = expected - min(expected, frsky_chstat_received[i]);
+
+    debug("CH ");
+    debug_put_uint8(i);
+    debug_putc(' ');
+    debug_put_hex8(storage.frsky_hop_table[i]);
+    debug_putc(' ');
+    debug_put_uint8(frsky_chstat_received[i]);
+    debug_putc(' ');
+    debug_put_uint8(lost);
+    debug_putc(' ');
+    debug_put_uint8(frsky_chstat_rssi[i]);
+    debug_put_newline();
+
+    frsky_chstat_dump_idx++;
+}
+
+//filtered rssi, new values get a weight of 1/8
+void frsky_rssi_update(uint8_t rssi){
+    frsky_rssi_filter = frsky_rssi_filter - (frsky_rssi_filter >> 3) + rssi;
+    frsky_rssi = frsky_rssi_filter >> 3;
+}
+
+//account one hop slot, frsky_link_quality is the number of
+//received packets within the last FRSKY_LQ_WINDOW slots
+void frsky_lq_update(uint8_t received){
+    uint8_t mask = 1 << (frsky_lq_index & 7);
+    __xdata uint8_t *history = &frsky_lq_history[frsky_lq_index >> 3];
+
+    //remove the oldest slot from the count and replace it
+    if (*history & mask){
+        frsky_link_quality--;
+    }
+    if (received){
+        *history |= mask;
+        frsky_link_quality++;
+    }else{
+        *history &= ~mask;
+    }
+
+    frsky_lq_index++;
+    if (frsky_lq_index >= FRSKY_LQ_WINDOW){
+        frsky_lq_index = 0;
+    }
+}
+
+void frsky_txpower_set(uint8_t level){
+    frsky_txpower_level = level;
+    PA_TABLE0 = frsky_txpower_table[level];
+}
+
+//adapt the telemetry tx power to the link, called once per rx frame.
+//missing is the number of rx frames missed in a row (telemetry frames
+//are no misses, the tx does not send there)
+void frsky_txpower_update(uint8_t missing){
+    if (frsky_conn_lost || (missing >= FRSKY_TXPOWER_MISS_MAX)){
+        //safe fallback, the tx might be far away
+        if (frsky_txpower_level){
+            frsky_txpower_set(0);
+        }
+        frsky_txpower_ticks = 0;
+        return;
+    }
+
+    frsky_txpower_ticks++;
+    if (frsky_txpower_ticks < FRSKY_TXPOWER_INTERVAL){
+        return;
+    }
+    frsky_txpower_ticks = 0;
+
+    if (frsky_link_quality < FRSKY_TXPOWER_LQ_MIN){
+        frsky_txpower_set(0);
+    }else if (frsky_rssi < FRSKY_RSSI_LEVEL(FRSKY_TXPOWER_RSSI_UP_DBM)){
+        //link gets weaker, increase fast
+        frsky_txpower_set((frsky_txpower_level > 2) ? (frsky_txpower_level - 2) : 0);
+    }else if ((frsky_rssi > FRSKY_RSSI_LEVEL(FRSKY_TXPOWER_RSSI_DOWN_DBM)) &&
+              (frsky_link_quality >= FRSKY_TXPOWER_LQ_DOWN) &&
+              (frsky_txpower_level < FRSKY_TXPOWER_LEVELS - 1)){
+        //strong link, reduce slowly
+        frsky_txpower_set(frsky_txpower_level + 1);
+    }
+}
+
 void frsky_main(void){
-    uint8_t send_telemetry = 0;
+    __xdata uint8_t *packet;
     uint8_t requested_telemetry_id = 0;
     uint8_t missing = 0;
     uint8_t hopcount = 0;
     uint8_t stat_rxcount = 0;
+    uint8_t lost_periods = 0;
     //uint8_t badrx_test = 0;
-    uint8_t conn_lost = 1;
     uint8_t packet_received = 0;
+    uint8_t telemetry_frame;
     //uint8_t i;
 
     debug("frsky: starting main loop\n");
 
+    //learned offset tracking
+    frsky_afc_init();
+
+    //per channel stats
+    frsky_chstat_init();
+
     //start with any channel:
     frsky_current_ch_idx = 0;
     //first set channel uses enter rxmode, this will set up dma etc
     frsky_enter_rxmode(storage.frsky_hop_table[frsky_current_ch_idx]);
 
-    //wait 500ms on the current ch on powerup
-    timeout_set(500);
-
     //start with conn lost (allow full sync)
-    conn_lost = 1;
+    frsky_conn_lost = 1;
     apa102_show_no_connection();
 
     //reset wdt once in order to have at least one second waiting for a packet:
     wdt_reset();
 
-    //make sure we never read the same packet twice by crc flag
-    frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE-1] = 0x00;
-conn_lost = 1;
+    //wait 500ms on the current ch on powerup, hopping is done by timer4 from now on
+    frsky_hop_timer_start();
+
     //start main loop
     while(1){
-        if (timeout_timed_out()){
-            LED_RED_ON();
+        //enter failsafe if there was no valid packet for too long
+        failsafe_update();
 
-            //next hop in 9ms
-            if (!conn_lost){
-                timeout_set(9);
-            }else{
-                timeout_set(500);
-            }
+        packet = frsky_rx_fetch();
+        if (packet){
+            //valid packet?
+            if (FRSKY_VALID_PACKET(packet)){
+                //ok, valid packet for us
+                LED_GREEN_ON();
 
-            frsky_increment_channel(1);
+                //the hop timer was synced to this packet by the rf interrupt,
+                //a telemetry slot (every 4th frame) is scheduled there as well
 
-            //strange delay from spi dumps
-            delay_us(1000);
+                //reset wdt
+                wdt_reset();
 
-            //go back to rx mode
-            frsky_packet_received = 0;
-            DMAARM = DMA_ARM_CH0;
-            RFST = RFST_SRX;
+                //reset missing packet counter
+                missing = 0;
 
-            //if enabled, send a sbus frame in case we lost that frame:
-            #if SBUS_ENABLED
-            if (!packet_received){
-                //frame was lost, so there was no channel value update
-                //and no transmission for the last frame slot.
-                //therefore we will do a transmission now
-                //(frame lost packet flag will be set)
-                sbus_start_transmission(SBUS_FRAME_LOST);
+                //always store the last telemtry request id
+                requested_telemetry_id   = packet[4];
+
+                //keep a telemetry packet ready, build it in idle time after
+                //the last slot. it is not rebuilt for the announcing packet
+                //(1.4ms before the slot), the hop timer sets the frame id
+                if ((!frsky_telemetry_ready) ||
+                    (((packet[3] & 0x03) != 2) && (requested_telemetry_id != frsky_telemetry_built_id))){
+                    frsky_telemetry_prepare(requested_telemetry_id);
+                }
+
+                //stats
+                stat_rxcount++;
+                packet_received=1;
+
+                //extract rssi in frsky format
+                frsky_rssi_update(frsky_extract_rssi(packet[FRSKY_PACKET_BUFFER_SIZE-2]));
+
+                //extract channel data:
+                frsky_update_ppm(packet);
+
+                //track carrier drift
+                frsky_afc_update(frsky_rx_buffer[frsky_rx_locked_idx].freqest);
+
+                //debug_put_hex8(buffer[3]);
+
+                LED_GREEN_OFF();
             }
-            #endif
+
+            //per channel statistics
+            frsky_chstat_packet(frsky_rx_buffer[frsky_rx_locked_idx].hop_idx, packet);
+        }
+
+        if (frsky_hop_event){
+            //timer4 started a new 9ms frame (hopped or searching)
+            telemetry_frame = (frsky_hop_event == FRSKY_HOP_EVENT_TELEMETRY);
+            frsky_hop_event = FRSKY_HOP_EVENT_NONE;
+            LED_RED_ON();
+
+            //per channel statistics
+            frsky_chstat_hop();
+
+            //sliding window link quality
+            frsky_lq_update(packet_received);
 
             //check for packets
             if (packet_received){
-                debug_putc('.');
+                frsky_debug_hop_putc('.');
+            }else if (telemetry_frame){
+                //the tx listened for our telemetry, this is not a miss
+                frsky_debug_hop_putc('t');
             }else{
-                debug_putc('!');
+                frsky_debug_hop_putc('!');
                 missing++;
+                if ((!frsky_conn_lost) && (missing > frsky_stat_miss_streak)){
+                    frsky_stat_miss_streak = missing;
+                }
             }
             packet_received = 0;
 
+            #if FRSKY_TXPOWER_ADAPTIVE
+            //telemetry tx power, only frames where the tx sends count
+            if (!telemetry_frame){
+                frsky_txpower_update(missing);
+            }
+            #endif
+
             if (hopcount++ >= 100){
                 debug("STAT: ");
                 debug_put_uint8(stat_rxcount);
+                debug(" P=0x");
+                debug_put_hex8(HI(frsky_hop_period));
+                debug_put_hex8(LO(frsky_hop_period));
+                debug(" E=");
+                debug_put_int8(frsky_hop_phase_error);
+                debug(" RXOVF=");
+                debug_put_uint8(frsky_stat_rxovf);
+                debug(" TXUNF=");
+                debug_put_uint8(frsky_stat_txunf);
+                debug(" TXTO=");
+                debug_put_uint8(frsky_stat_txtimeout);
+                debug(" TXSKIP=");
+                debug_put_uint8(frsky_stat_txskip);
+                debug(" OFS=");
+                debug_put_int8(frsky_afc_offset);
+                debug(" MISS=");
+                debug_put_uint8(frsky_stat_miss_streak);
+                debug(" PWR=");
+                debug_put_uint8(frsky_txpower_level);
                 debug_put_newline();
 
-                //link quality
-                frsky_link_quality = stat_rxcount;
-
                 if (stat_rxcount==0){
-                    conn_lost = 1;
+                    frsky_conn_lost = 1;
                     //enter failsafe mode
                     failsafe_enter();
                     debug("\nCONN LOST!\n");
                     //no connection led info
                     apa102_show_no_connection();
+                    //do not send stale telemetry once the link is back
+                    frsky_telemetry_ready = 0;
+
+                    //persist the afc offset once the link was down for a while
+                    //(tx switched off, model on the ground), not on every loss
+                    if (lost_periods < FRSKY_AFC_STORE_LOST_PERIODS){
+                        lost_periods++;
+                        if (lost_periods == FRSKY_AFC_STORE_LOST_PERIODS){
+                            frsky_afc_store();
+                        }
+                    }
+                }else{
+                    lost_periods = 0;
                 }
 
                 //statistics
@@ -790,75 +1836,10 @@ conn_lost = 1;
             LED_RED_OFF();
         }
 
-        //handle ovfs
-        frsky_handle_overflows();
-
-        if (frsky_packet_received){
-            //valid packet?
-            if (FRSKY_VALID_PACKET(frsky_packet_buffer)){
-                //ok, valid packet for us
-                LED_GREEN_ON();
-
-                //we hop to the next channel in 0.5ms
-                //afterwards hops are in 9ms grid again
-                //this way we can have up to +/-1ms jitter on our 9ms timebase
-                //without missing packets
-                delay_us(500);
-                timeout_set(0);
-
-                //reset wdt
-                wdt_reset();
-
-                //reset missing packet counter
-                missing = 0;
-
-                //every 4th frame is a telemetry frame (transmits every 36ms)
-                if ((frsky_packet_buffer[3] % 4) == 2){
-                    //next frame is a telemetry frame
-                    send_telemetry = 1;
-                }
-                //always store the last telemtry request id
-                requested_telemetry_id   = frsky_packet_buffer[4];
-
-                //stats
-                stat_rxcount++;
-                packet_received=1;
-                conn_lost = 0;
-
-                //extract rssi in frsky format
-                frsky_rssi = frsky_extract_rssi(frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE-2]);
-
-                //extract channel data:
-                frsky_update_ppm();
-
-                //debug_put_hex8(buffer[3]);
-
-                //make sure we never read the same packet twice by crc flag
-                frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE-1] = 0x00;
-
-                LED_GREEN_OFF();
-            }else{
-                //mark packet as invalid
-                frsky_packet_received = 0;
-            }
-        }
-
-        if (send_telemetry){
-            //set timeout to 9ms grid
-            timeout_set(9);
-
-            //change channel:
-            frsky_increment_channel(1);
-
-            //DO NOT go to SRX here
-            delay_us(900); //1340-500
-
-            //build & send packet
-            frsky_send_telemetry(requested_telemetry_id);
-
-            //mark as done
-            send_telemetry = 0;
-        }
+        #if FRSKY_HUB_PASSTHROUGH
+        //external hub sensors on the uart
+        frsky_hub_passthrough_process();
+        #endif
 
         //process leds:
         apa102_statemachine();
@@ -872,6 +1853,7 @@ conn_lost = 1;
 //useful for debugging/sniffing packets from anothe tx or rx
 //make sure to bind this rx before using this...
 void frsky_frame_sniffer(void){
+    __xdata uint8_t *packet;
     uint8_t send_telemetry = 0;
     uint8_t missing = 0;
     uint8_t hopcount = 0;
@@ -916,7 +1898,7 @@ void frsky_frame_sniffer(void){
             delay_us(1000);
 
             //go back to rx mode
-            frsky_packet_received = 0;
+            DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
             DMAARM = DMA_ARM_CH0;
             RFST = RFST_SRX;
 
@@ -947,11 +1929,9 @@ void frsky_frame_sniffer(void){
             LED_RED_OFF();
         }
 
-        //handle ovfs
-        frsky_handle_overflows();
-
-        if (frsky_packet_received){
-            if (FRSKY_VALID_PACKET(frsky_packet_buffer)){
+        packet = frsky_rx_fetch();
+        if (packet){
+            if (FRSKY_VALID_PACKET(packet)){
                 //ok, valid packet for us
                 LED_GREEN_ON();
 
@@ -964,7 +1944,7 @@ void frsky_frame_sniffer(void){
                 }
 
                 for(i=0; i<FRSKY_PACKET_BUFFER_SIZE; i++){
-                    debug_put_hex8(frsky_packet_buffer[i]);
+                    debug_put_hex8(packet[i]);
                     debug_putc(' ');
                 }
                 debug("\n");
@@ -983,7 +1963,7 @@ void frsky_frame_sniffer(void){
                 missing = 0;
 
                 //every 4th frame is a telemetry frame (transmits every 36ms)
-                if ((frsky_packet_buffer[3] % 4) == 2){
+                if ((packet[3] % 4) == 2){
                     send_telemetry = 1;
                 }
 
@@ -992,9 +1972,6 @@ void frsky_frame_sniffer(void){
                 packet_received=1;
                 conn_lost = 0;
 
-                //make sure we never read the same packet twice by crc flag
-                frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE-1] = 0x00;
-
                 LED_GREEN_OFF();
             }
         }
@@ -1024,17 +2001,24 @@ void frsky_increment_channel(int8_t cnt){
 }
 
 
-void frsky_send_telemetry(uint8_t telemetry_id){
+//assemble the next telemetry packet in frsky_packet_buffer.
+//this is done in idle time, the hop timer only sets the frame id of the
+//announcing packet and starts the transmission
+void frsky_telemetry_prepare(uint8_t telemetry_id){
+    #if FRSKY_SEND_HUB_TELEMETRY
+    uint8_t bytes_used;
+    #else
     uint8_t i;
-    //uint16_t tmp16;
-    uint8_t bytes_used = 0;
-    static uint8_t test = 0;
+    #endif
 
-    //Stop RX DMA
-    RFST = RFST_SIDLE;
-    //abort ch0
-    DMAARM = DMA_ARM_ABORT | DMA_ARM_CH0;
-    frsky_setup_rf_dma(FRSKY_MODE_TX);
+    //invalidate the old packet before touching the buffer, the hop timer
+    //isr must never start a transmission of a half built packet
+    frsky_telemetry_ready = 0;
+
+    if (frsky_mode == FRSKY_MODE_TX){
+        //the dma is still reading the buffer
+        return;
+    }
 
     //length of byte (always 0x11 = 17 bytes)
     frsky_packet_buffer[0] = 0x11;
@@ -1049,27 +2033,16 @@ void frsky_send_telemetry(uint8_t telemetry_id){
 
     //send ampere and voltage as hub telemetry data as well
     #if FRSKY_SEND_HUB_TELEMETRY
-        //use telemetry id to decide which packet to send:
-        if (telemetry_id & 1){
-            //send voltage packet (undocumented sensor 0x39 = volts in 0.1 steps)
-            tmp16 = test++; //123; //12.3V
-            //convert adc to voltage:
-            //float v = (vraw * 3.3/1024.0) * (ADC0_DIVIDER_A + ADC0_DIVIDER_B)) / (ADC0_DIVIDER_B);
-            //continue here
-            bytes_used = frsky_append_hub_data(FRSKY_HUB_TELEMETRY_VOLTAGE, tmp16, &frsky_packet_buffer[8]);
-        }else{
-            //send current
-            tmp16 = 456; //45.6A
-            bytes_used = frsky_append_hub_data(FRSKY_HUB_TELEMETRY_CURRENT, tmp16, &frsky_packet_buffer[8]);
-        }
+        //queue sensor data that is due
+        frsky_hub_fill();
+
+        //up to 10 bytes of the hub data stream
+        bytes_used = frsky_hub_build_frame(telemetry_id, &frsky_packet_buffer[8]);
 
         //number of valid data bytes:
         frsky_packet_buffer[6] = bytes_used;
         //set up frame id
         frsky_packet_buffer[7] = telemetry_id;
-
-        //do not use rest of frame, use only one hub frame per packet
-        //in order not to have to handle the datastream splitting operation
     #else
         //no telemetry -> at least[6]+[7] should be zero
         //bytes 6-17 are zero
@@ -1082,51 +2055,17 @@ void frsky_send_telemetry(uint8_t telemetry_id){
     //it is important to call this after reading the values...
     adc_process();
 
-    //arm dma channel
-    RFST = RFST_STX;
-    DMAARM = DMA_ARM_CH0;
-
-    //tricky: this will force an int request and
-    //        initiate the actual transmission
-    S1CON |= 0x03;
-
-    //wait some time here. packet should be sent within our 9ms
-    //frame (actually within 5-6ms). if not print an error...
-    frsky_packet_sent = 0;
-    while(!frsky_packet_sent){
-        if (timeout_timed_out()){
-            break;
-        }
-    }
-    if (timeout_timed_out()){
-        debug("\nfrsky: ERROR tx timed out\n");
-    }
-
-    frsky_packet_sent = 0;
-
-    frsky_setup_rf_dma(FRSKY_MODE_RX);
-    DMAARM = DMA_ARM_CH0;
-    RFST = RFST_SRX;
-}
-
-uint8_t frsky_extract_rssi(uint8_t rssi_raw){
-    #define FRSKY_RSSI_OFFSET 70
-    if (rssi_raw >= 128){
-        //adapted to fit better to the original values... FIXME: find real formula
-        //return (rssi_raw * 18)/32 - 82;
-        return ((((uint16_t)rssi_raw) * 18)>>5) - 82;
-    }else{
-        return ((((uint16_t)rssi_raw) * 18)>>5) + 65;
-    }
+    frsky_telemetry_built_id = telemetry_id;
+    frsky_telemetry_ready = 1;
 }
 
-void frsky_update_ppm(void){
+void frsky_update_ppm(__xdata uint8_t *packet){
     //build uint16_t array from data:
     __xdata uint16_t channel_data[8];
 
     /*debug("[");debug_flush();
     for(cnt=0; cnt<FRSKY_PACKET_BUFFER_SIZE; cnt++){
-        debug_put_hex8(frsky_packet_buffer[cnt]);
+        debug_put_hex8(packet[cnt]);
         debug_putc(' ');
         debug_flush();
     }
@@ -1134,17 +2073,17 @@ void frsky_update_ppm(void){
     */
 
     //extract channel data from packet:
-    channel_data[0] = (uint16_t)(((frsky_packet_buffer[10] & 0x0F)<<8 | frsky_packet_buffer[6]));
-    channel_data[1] = (uint16_t)(((frsky_packet_buffer[10] & 0xF0)<<4 | frsky_packet_buffer[7]));
-    channel_data[2] = (uint16_t)(((frsky_packet_buffer[11] & 0x0F)<<8 | frsky_packet_buffer[8]));
-    channel_data[3] = (uint16_t)(((frsky_packet_buffer[11] & 0xF0)<<4 | frsky_packet_buffer[9]));
-    channel_data[4] = (uint16_t)(((frsky_packet_buffer[16] & 0x0F)<<8 | frsky_packet_buffer[12]));
-    channel_data[5] = (uint16_t)(((frsky_packet_buffer[16] & 0xF0)<<4 | frsky_packet_buffer[13]));
-    channel_data[6] = (uint16_t)(((frsky_packet_buffer[17] & 0x0F)<<8 | frsky_packet_buffer[14]));
-    channel_data[7] = (uint16_t)(((frsky_packet_buffer[17] & 0xF0)<<4 | frsky_packet_buffer[15]));
+    channel_data[0] = (uint16_t)(((packet[10] & 0x0F)<<8 | packet[6]));
+    channel_data[1] = (uint16_t)(((packet[10] & 0xF0)<<4 | packet[7]));
+    channel_data[2] = (uint16_t)(((packet[11] & 0x0F)<<8 | packet[8]));
+    channel_data[3] = (uint16_t)(((packet[11] & 0xF0)<<4 | packet[9]));
+    channel_data[4] = (uint16_t)(((packet[16] & 0x0F)<<8 | packet[12]));
+    channel_data[5] = (uint16_t)(((packet[16] & 0xF0)<<4 | packet[13]));
+    channel_data[6] = (uint16_t)(((packet[17] & 0x0F)<<8 | packet[14]));
+    channel_data[7] = (uint16_t)(((packet[17] & 0xF0)<<4 | packet[15]));
 
     //set apa leds:
-    apa102_update_leds(channel_data, frsky_link_quality);
+    apa102_update_leds(channel_data, frsky_link_quality, frsky_rssi);
     apa102_start_transmission();
 
     //exit failsafe mode
@@ -1152,48 +2091,331 @@ void frsky_update_ppm(void){
 
     //copy to output module:
     #if SBUS_ENABLED
+    //sent by the sbus timer
     sbus_update(channel_data);
-    sbus_start_transmission(SBUS_FRAME_NOT_LOST);
     #else
     ppm_update(channel_data);
     #endif
 }
 
 
-uint8_t frsky_append_hub_data(uint8_t sensor_id, uint16_t value, uint8_t *buf){
-    uint8_t index = 0;
-    uint8_t val8;
+#if FRSKY_SEND_HUB_TELEMETRY
+//number of bytes waiting in the hub ring buffer (incl. the frame in flight)
+uint8_t frsky_hub_used(void){
+    return (frsky_hub_head - frsky_hub_tail) & FRSKY_HUB_BUFFER_MASK;
+}
 
-    //add header:
-    buf[index++] = FRSKY_HUB_TELEMETRY_HEADER;
-    //add sensor id
-    buf[index++] = sensor_id;
-    //add data, take care of byte stuffing
-    //low byte
-    val8 = LO(value);
-    if (val8 == 0x5E){
-        buf[index++] = 0x5D;
-        buf[index++] = 0x3E;
-    }else if (val8 == 0x5D){
-        buf[index++] = 0x5D;
-        buf[index++] = 0x3D;
-    }else{
-        buf[index++] = val8;
-    }
-    //high byte
-    val8 = HI(value);
-    if (val8 == 0x5E){
-        buf[index++] = 0x5D;
-        buf[index++] = 0x3E;
-    }else if (val8 == 0x5D){
-        buf[index++] = 0x5D;
-        buf[index++] = 0x3D;
+void frsky_hub_put(uint8_t val){
+    frsky_hub_buffer[frsky_hub_head] = val;
+    frsky_hub_head = (frsky_hub_head + 1) & FRSKY_HUB_BUFFER_MASK;
+}
+
+//add a data byte, take care of byte stuffing
+void frsky_hub_put_stuffed(uint8_t val){
+    if (val == 0x5E){
+        frsky_hub_put(0x5D);
+        frsky_hub_put(0x3E);
+    }else if (val == 0x5D){
+        frsky_hub_put(0x5D);
+        frsky_hub_put(0x3D);
     }else{
-        buf[index++] = val8;
+        frsky_hub_put(val);
+    }
+}
+
+//queue one hub record (header, id, lo, hi). the header of the next record
+//terminates this one, call frsky_hub_end() after the last record. the header
+//is skipped if the stream already ends with a delimiter (from the last fill).
+//returns the number of bytes queued, 0 if the buffer is full
+uint8_t frsky_append_hub_data(uint8_t sensor_id, uint16_t value){
+    uint8_t used = frsky_hub_used();
+
+    //worst case: both data bytes stuffed, keep room for the footer
+    if (used + FRSKY_HUB_RECORD_MAX_LEN + 1 >= FRSKY_HUB_BUFFER_SIZE){
+        return 0;
+    }
+
+    //add header, a single 0x5E ends the last record and starts this one
+    if (!frsky_hub_delimited){
+        frsky_hub_put(FRSKY_HUB_TELEMETRY_HEADER);
+    }
+    frsky_hub_delimited = 0;
+    //add sensor id
+    frsky_hub_put(sensor_id);
+    //add data, low byte first
+    frsky_hub_put_stuffed(LO(value));
+    frsky_hub_put_stuffed(HI(value));
+
+    return frsky_hub_used() - used;
+}
+
+//terminate the last record
+void frsky_hub_end(void){
+    if (frsky_hub_used() + 1 < FRSKY_HUB_BUFFER_SIZE){
+        frsky_hub_put(FRSKY_HUB_TELEMETRY_HEADER);
+        frsky_hub_delimited = 1;
+    }
+}
+
+void frsky_telemetry_sched_init(void){
+    uint8_t i;
+
+    for(i=0; i<FRSKY_TELEMETRY_SENSOR_COUNT; i++){
+        //stagger the first updates
+        frsky_telemetry_sensor_due[i] = i;
+        frsky_telemetry_sensor_overdue[i] = 0;
+    }
+}
+
+//current value of a scheduled sensor in hub format
+uint16_t frsky_telemetry_sensor_value(uint8_t hub_id){
+    switch(hub_id){
+        default:
+        case(FRSKY_HUB_TELEMETRY_CURRENT):
+            //0.1A steps
+            return adc_get_current();
+        case(FRSKY_HUB_TELEMETRY_VOLTAGE):
+            //undocumented sensor 0x39 = volts in 0.1 steps
+            return adc_get_voltage();
+        case(FRSKY_HUB_TELEMETRY_TEMPERATURE2):
+            //rssi in frsky format
+            return frsky_rssi;
+        case(FRSKY_HUB_TELEMETRY_FUEL):
+            //received packets out of the last 100
+            return frsky_link_quality;
+        #if FRSKY_TELEMETRY_DIAGNOSTICS
+        case(FRSKY_HUB_TELEMETRY_TEMPERATURE1):
+            //rf errors: fifo over/underflows, telemetry tx timeouts and skipped slots
+            return (uint16_t)frsky_stat_rxovf + frsky_stat_txunf + frsky_stat_txtimeout + frsky_stat_txskip;
+        case(FRSKY_HUB_TELEMETRY_RPM):
+            //longest run of missed frames
+            return frsky_stat_miss_streak;
+        case(FRSKY_HUB_TELEMETRY_ACCEL_X):
+            //adc dma transfers not finished in time
+            return adc_stat_dma_miss;
+        case(FRSKY_HUB_TELEMETRY_ACCEL_Y):
+            //debug output lost due to a full uart buffer
+            return uart_stat_tx_overflow;
+        case(FRSKY_HUB_TELEMETRY_ACCEL_Z):
+            //last reset cause, 2 = watchdog
+            return wdt_reset_cause;
+        case(FRSKY_HUB_TELEMETRY_GPS_COURSE):
+            //telemetry tx power level, 0 = full power
+            return frsky_txpower_level;
+        #endif
+    }
+}
+
+//telemetry scheduler, called once per telemetry slot (36ms).
+//queues all sensors that are due, highest priority first. sensors that do
+//not fit gain priority for every slot they have to wait
+void frsky_hub_fill(void){
+    uint8_t i;
+    uint8_t best;
+    uint8_t score;
+    uint8_t best_score;
+    uint16_t queued = 0;
+
+    for(i=0; i<FRSKY_TELEMETRY_SENSOR_COUNT; i++){
+        if (frsky_telemetry_sensor_due[i]){
+            frsky_telemetry_sensor_due[i]--;
+        }
+    }
+
+    //keep the backlog short, this keeps the data fresh
+    while(frsky_hub_used() < 2*FRSKY_HUB_MAX_PAYLOAD){
+        //find the due sensor with the highest priority
+        best = 0xFF;
+        best_score = 0;
+        for(i=0; i<FRSKY_TELEMETRY_SENSOR_COUNT; i++){
+            if ((frsky_telemetry_sensor_due[i] == 0) && !(queued & (1<<i))){
+                score = frsky_telemetry_sensors[i].priority + frsky_telemetry_sensor_overdue[i];
+                if ((best == 0xFF) || (score > best_score)){
+                    best = i;
+                    best_score = score;
+                }
+            }
+        }
+
+        if (best == 0xFF){
+            //nothing left to send
+            break;
+        }
+
+        if (!frsky_append_hub_data(frsky_telemetry_sensors[best].hub_id,
+                                   frsky_telemetry_sensor_value(frsky_telemetry_sensors[best].hub_id))){
+            //buffer full
+            break;
+        }
+
+        queued |= (1<<best);
+        frsky_telemetry_sensor_due[best] = frsky_telemetry_sensors[best].interval;
+        frsky_telemetry_sensor_overdue[best] = 0;
+    }
+
+    //everything still due has to wait for the next slot
+    for(i=0; i<FRSKY_TELEMETRY_SENSOR_COUNT; i++){
+        if ((frsky_telemetry_sensor_due[i] == 0) && !(queued & (1<<i))){
+            if (frsky_telemetry_sensor_overdue[i] < 0xFF - FRSKY_TELEMETRY_PRIORITY_MAX){
+                frsky_telemetry_sensor_overdue[i]++;
+            }
+        }
+    }
+
+    #if FRSKY_HUB_PASSTHROUGH
+    //external sensors get the remaining bandwidth
+    if (frsky_hub_passthrough_fill()){
+        queued = 1;
+    }
+    #endif
+
+    if (queued){
+        frsky_hub_end();
+    }
+}
+
+#if FRSKY_HUB_PASSTHROUGH
+void frsky_hub_passthrough_init(void){
+    uint8_t i;
+
+    for(i=0; i<FRSKY_HUB_PT_SLOTS; i++){
+        frsky_hub_pt_id[i] = FRSKY_HUB_PT_EMPTY;
+    }
+    frsky_hub_pt_pending = 0;
+    frsky_hub_pt_next = 0;
+    frsky_hub_pt_state = FRSKY_HUB_PT_SYNC;
+    frsky_hub_pt_escape = 0;
+}
+
+//parse the hub data stream from the uart, called from the main loop.
+//records are unstuffed here and stuffed again when queued for the downlink
+void frsky_hub_passthrough_process(void){
+    uint8_t ch;
+
+    if (uart_rx_lost){
+        //the record in progress is missing a byte, wait for the next one
+        uart_rx_lost = 0;
+        frsky_hub_pt_state = FRSKY_HUB_PT_SYNC;
+    }
+
+    while(uart_rx_available()){
+        ch = uart_getc();
+
+        if (ch == FRSKY_HUB_TELEMETRY_HEADER){
+            //header terminates the last record and starts a new one
+            frsky_hub_pt_state = 0;
+            frsky_hub_pt_escape = 0;
+        }else if (frsky_hub_pt_state < 3){
+            if (ch == FRSKY_HUB_TELEMETRY_STUFFING){
+                frsky_hub_pt_escape = 1;
+            }else{
+                if (frsky_hub_pt_escape){
+                    //0x5D 0x3E = 0x5E, 0x5D 0x3D = 0x5D
+                    ch ^= 0x60;
+                    frsky_hub_pt_escape = 0;
+                }
+                frsky_hub_pt_record[frsky_hub_pt_state++] = ch;
+                if (frsky_hub_pt_state == 3){
+                    frsky_hub_passthrough_store();
+                    //ignore everything up to the next header
+                    frsky_hub_pt_state = FRSKY_HUB_PT_SYNC;
+                }
+            }
+        }
+    }
+}
+
+//keep the latest value of the parsed record. the slot of a sensor id is
+//reused, cell voltages use one slot per cell
+void frsky_hub_passthrough_store(void){
+    uint8_t i;
+    uint8_t slot = 0xFF;
+    uint8_t id = frsky_hub_pt_record[0];
+
+    if (id == FRSKY_HUB_PT_EMPTY){
+        return;
+    }
+
+    for(i=0; i<FRSKY_HUB_PT_SLOTS; i++){
+        if (frsky_hub_pt_id[i] == id){
+            if ((id != FRSKY_HUB_TELEMETRY_CELLS) ||
+                (((LO(frsky_hub_pt_value[i]) ^ frsky_hub_pt_record[1]) & 0xF0) == 0)){
+                slot = i;
+                break;
+            }
+        }else if ((slot == 0xFF) && !(frsky_hub_pt_pending & (1<<i))){
+            //unused or already forwarded slot, take it in case this is a new sensor
+            slot = i;
+        }
+    }
+
+    if (slot == 0xFF){
+        //all slots wait for the downlink, drop this record
+        return;
+    }
+
+    frsky_hub_pt_id[slot] = id;
+    frsky_hub_pt_value[slot] = ((uint16_t)frsky_hub_pt_record[2] << 8) | frsky_hub_pt_record[1];
+    frsky_hub_pt_pending |= (1<<slot);
+}
+
+//queue pending external records round robin, keep the backlog short.
+//returns 1 if anything was queued
+uint8_t frsky_hub_passthrough_fill(void){
+    uint8_t i;
+    uint8_t slot;
+    uint8_t queued = 0;
+
+    for(i=0; i<FRSKY_HUB_PT_SLOTS; i++){
+        if (frsky_hub_used() >= 2*FRSKY_HUB_MAX_PAYLOAD){
+            break;
+        }
+
+        slot = frsky_hub_pt_next;
+        if (frsky_hub_pt_pending & (1<<slot)){
+            if (!frsky_append_hub_data(frsky_hub_pt_id[slot], frsky_hub_pt_value[slot])){
+                //buffer full
+                break;
+            }
+            frsky_hub_pt_pending &= ~(1<<slot);
+            queued = 1;
+        }
+
+        frsky_hub_pt_next++;
+        if (frsky_hub_pt_next >= FRSKY_HUB_PT_SLOTS){
+            frsky_hub_pt_next = 0;
+        }
+    }
+
+    return queued;
+}
+#endif
+
+//copy the next chunk of the hub stream to the telemetry packet.
+//the tx requests frame ids: a repeated id means the last frame was lost,
+//resend it. a new id acknowledges the last frame
+uint8_t frsky_hub_build_frame(uint8_t telemetry_id, __xdata volatile uint8_t *buf){
+    uint8_t i;
+    uint8_t used;
+
+    if (telemetry_id != frsky_hub_tx_id){
+        //drop acknowledged data
+        frsky_hub_tail = (frsky_hub_tail + frsky_hub_tx_len) & FRSKY_HUB_BUFFER_MASK;
+
+        //fill up the new frame, records may span several frames
+        used = frsky_hub_used();
+        frsky_hub_tx_len = min(used, FRSKY_HUB_MAX_PAYLOAD);
+        frsky_hub_tx_id = telemetry_id;
+    }
+
+    for(i=0; i<FRSKY_HUB_MAX_PAYLOAD; i++){
+        if (i < frsky_hub_tx_len){
+            buf[i] = frsky_hub_buffer[(frsky_hub_tail + i) & FRSKY_HUB_BUFFER_MASK];
+        }else{
+            buf[i] = 0x00;
+        }
     }
-    //add footer:
-    buf[index] = FRSKY_HUB_TELEMETRY_HEADER;
 
-    //return index:
-    return index;
+    return frsky_hub_tx_len;
 }
+#endif
@@ -4,6 +4,7 @@
 #include "main.h"
 #include "cc2510fx.h"
 #include "dma.h"
+#include "config.h"
 
 #define FRSKY_HOPTABLE_SIZE 47
 //
@@ -14,45 +15,330 @@ extern __xdata uint8_t frsky_current_ch_idx;
 //rssi
 extern __xdata uint8_t frsky_rssi;
 extern __xdata uint8_t frsky_link_quality;
-//pll calibration
-extern __xdata uint8_t frsky_calib_fscal1_table[FRSKY_HOPTABLE_SIZE];
-extern __xdata uint8_t frsky_calib_fscal2;
-extern __xdata uint8_t frsky_calib_fscal3;
+extern __xdata uint16_t frsky_rssi_filter;
+
+//rssi conversion: the appended status byte is the rssi in 0.5dB steps
+//(two's complement), rssi_dbm = raw/2 - offset (cc2510 datasheet, 250kBaud)
+#define FRSKY_RSSI_OFFSET_DBM 72
+//raw value as signed int and in 2*dBm
+#define FRSKY_RSSI_SIGNED(_raw) ((_raw) >= 128 ? (int16_t)(_raw) - 256 : (int16_t)(_raw))
+#define FRSKY_RSSI_DBM2(_raw)   (FRSKY_RSSI_SIGNED(_raw) - 2*FRSKY_RSSI_OFFSET_DBM)
+#if FRSKY_RSSI_UNIT_DBM
+//report dBm as int8, all values are negative -> still monotonic as uint8
+#define FRSKY_RSSI_LUT_VAL(_raw) ((uint8_t)(int8_t)(FRSKY_RSSI_DBM2(_raw) < -256 ? -128 : \
+                                  (FRSKY_RSSI_DBM2(_raw) > -2 ? -1 : FRSKY_RSSI_DBM2(_raw) / 2)))
+#else
+//frsky scale: 9/8 per dB, 0 = -128dBm (matches the values the tx showed so far)
+#define FRSKY_RSSI_FRSKY(_raw)   ((9 * FRSKY_RSSI_DBM2(_raw) + 16 * 144 + 8) / 16)
+#define FRSKY_RSSI_LUT_VAL(_raw) ((uint8_t)(FRSKY_RSSI_FRSKY(_raw) < 0 ? 0 : \
+                                  (FRSKY_RSSI_FRSKY(_raw) > 255 ? 255 : FRSKY_RSSI_FRSKY(_raw))))
+#endif
+#define FRSKY_RSSI_LUT_4(_b)  FRSKY_RSSI_LUT_VAL((_b)+0), FRSKY_RSSI_LUT_VAL((_b)+1), \
+                              FRSKY_RSSI_LUT_VAL((_b)+2), FRSKY_RSSI_LUT_VAL((_b)+3)
+#define FRSKY_RSSI_LUT_16(_b) FRSKY_RSSI_LUT_4((_b)+0), FRSKY_RSSI_LUT_4((_b)+4), \
+                              FRSKY_RSSI_LUT_4((_b)+8), FRSKY_RSSI_LUT_4((_b)+12)
+extern __code uint8_t frsky_rssi_lut[256];
+//frsky_rssi value for a given dBm level (compile time only)
+#if FRSKY_RSSI_UNIT_DBM
+#define FRSKY_RSSI_LEVEL(_dbm) ((uint8_t)(int8_t)(_dbm))
+#else
+#define FRSKY_RSSI_LEVEL(_dbm) ((uint8_t)((9 * 2 * (_dbm) + 16 * 144 + 8) / 16))
+#endif
+//one table lookup per packet
+#define frsky_extract_rssi(_raw) (frsky_rssi_lut[(uint8_t)(_raw)])
+//link quality window in hop slots
+#define FRSKY_LQ_WINDOW 100
+
+//telemetry tx power control, level 0 = full power, 2dB per level
+#define FRSKY_TXPOWER_LEVELS 8
+//evaluate every n rx frames (~390ms, telemetry frames are not counted)
+#define FRSKY_TXPOWER_INTERVAL 32
+//uplink rssi above DOWN: reduce by one level, below UP: increase by two.
+//the uplink tells us the path loss, nothing happens in between (hysteresis)
+#define FRSKY_TXPOWER_RSSI_DOWN_DBM (-50)
+#define FRSKY_TXPOWER_RSSI_UP_DBM   (-65)
+//link quality needed to reduce power, below MIN go to full power.
+//the tx does not send in telemetry frames, 75 is the maximum
+#define FRSKY_TXPOWER_LQ_DOWN 72
+#define FRSKY_TXPOWER_LQ_MIN  65
+//missed rx frames in a row that force full power
+#define FRSKY_TXPOWER_MISS_MAX 3
+extern __code uint8_t frsky_txpower_table[FRSKY_TXPOWER_LEVELS];
+extern __xdata uint8_t frsky_txpower_level;
+extern __xdata uint8_t frsky_txpower_ticks;
+extern __xdata uint8_t frsky_lq_history[(FRSKY_LQ_WINDOW+7)/8];
+extern __xdata uint8_t frsky_lq_index;
 //extern __xdata int16_t frsky_freq_offset_acc;
 
 #define FRSKY_PACKET_LENGTH 17
 #define FRSKY_PACKET_BUFFER_SIZE (FRSKY_PACKET_LENGTH+3)
+
+//hub data stream ring buffer, size must be a power of 2
+#define FRSKY_HUB_BUFFER_SIZE 32
+#define FRSKY_HUB_BUFFER_MASK (FRSKY_HUB_BUFFER_SIZE-1)
+//telemetry packet bytes 8..17 carry hub data
+#define FRSKY_HUB_MAX_PAYLOAD 10
+//header + id + 2 stuffed data bytes
+#define FRSKY_HUB_RECORD_MAX_LEN 6
+
+#if FRSKY_SEND_HUB_TELEMETRY
+//telemetry scheduler table entry
+#if FRSKY_TELEMETRY_DIAGNOSTICS
+#define FRSKY_TELEMETRY_SENSOR_COUNT 10
+#else
+#define FRSKY_TELEMETRY_SENSOR_COUNT 4
+#endif
+#define FRSKY_TELEMETRY_PRIORITY_MAX 3
+typedef struct {
+    uint8_t hub_id;
+    //update interval in telemetry slots (36ms)
+    uint8_t interval;
+    //higher value wins if several sensors are due
+    uint8_t priority;
+} FRSKY_TELEMETRY_SENSOR;
+extern __code FRSKY_TELEMETRY_SENSOR frsky_telemetry_sensors[FRSKY_TELEMETRY_SENSOR_COUNT];
+extern __xdata uint8_t frsky_telemetry_sensor_due[FRSKY_TELEMETRY_SENSOR_COUNT];
+extern __xdata uint8_t frsky_telemetry_sensor_overdue[FRSKY_TELEMETRY_SENSOR_COUNT];
+#endif
+
+#if FRSKY_HUB_PASSTHROUGH
+#if !FRSKY_SEND_HUB_TELEMETRY
+#error "FRSKY_HUB_PASSTHROUGH needs FRSKY_SEND_HUB_TELEMETRY"
+#endif
+//external hub sensors: the latest record of every sensor id is kept and
+//forwarded with the bandwidth left by our own sensors. intermediate values
+//are dropped when the sensors send faster than the downlink (rate matching)
+#define FRSKY_HUB_PT_SLOTS 12
+//slot is unused (0x00 is not a valid hub id)
+#define FRSKY_HUB_PT_EMPTY 0x00
+//parser state: waiting for a header byte, otherwise index into frsky_hub_pt_record
+#define FRSKY_HUB_PT_SYNC 0xFF
+extern __xdata uint8_t frsky_hub_pt_id[FRSKY_HUB_PT_SLOTS];
+extern __xdata uint16_t frsky_hub_pt_value[FRSKY_HUB_PT_SLOTS];
+extern __xdata uint16_t frsky_hub_pt_pending;
+extern __xdata uint8_t frsky_hub_pt_next;
+//record being parsed: id, lo, hi (unstuffed)
+extern __xdata uint8_t frsky_hub_pt_record[3];
+extern __xdata uint8_t frsky_hub_pt_state;
+extern __xdata uint8_t frsky_hub_pt_escape;
+#endif
+
+//tx buffer
 extern __xdata volatile uint8_t frsky_packet_buffer[FRSKY_PACKET_BUFFER_SIZE];
-extern __xdata volatile uint8_t frsky_packet_received;
-extern __xdata volatile uint8_t frsky_packet_sent;
+extern __xdata DMA_DESC frsky_tx_dma_config;
+extern __xdata volatile uint8_t frsky_telemetry_ready;
+extern __xdata uint8_t frsky_telemetry_built_id;
+extern __xdata volatile uint8_t frsky_telemetry_id;
+
+//rx buffers, triple buffered: the dma always writes to a buffer
+//that is neither the newest packet nor the one in use by the main loop
+#define FRSKY_RX_BUFFER_COUNT 3
+typedef struct {
+    //sequence number, incremented for every received packet
+    uint8_t seq;
+    //reception time: timer4 ticks since the last hop
+    uint8_t timestamp;
+    //frequency offset estimate of this packet
+    int8_t freqest;
+    //hop index this packet was received on
+    uint8_t hop_idx;
+    //packet data incl. status bytes
+    uint8_t data[FRSKY_PACKET_BUFFER_SIZE];
+} FRSKY_RX_BUFFER;
+extern __xdata FRSKY_RX_BUFFER frsky_rx_buffer[FRSKY_RX_BUFFER_COUNT];
+extern __xdata volatile uint8_t frsky_rx_dma_idx;
+extern __xdata volatile uint8_t frsky_rx_ready_idx;
+extern __xdata volatile uint8_t frsky_rx_seq;
+extern __xdata volatile uint8_t frsky_rx_locked_idx;
+extern __xdata uint8_t frsky_rx_processed_seq;
 extern __xdata volatile uint8_t frsky_mode;
+extern __xdata uint16_t frsky_autotune_duration;
+extern __xdata uint16_t frsky_bind_hopdata_received;
+#if FRSKY_SEND_HUB_TELEMETRY
+extern __xdata uint8_t frsky_hub_buffer[FRSKY_HUB_BUFFER_SIZE];
+extern __xdata uint8_t frsky_hub_head;
+extern __xdata uint8_t frsky_hub_tail;
+extern __xdata uint8_t frsky_hub_tx_len;
+extern __xdata uint8_t frsky_hub_tx_id;
+extern __xdata uint8_t frsky_hub_delimited;
+#endif
+extern __xdata uint8_t frsky_chstat_received[FRSKY_HOPTABLE_SIZE];
+extern __xdata uint8_t frsky_chstat_rssi[FRSKY_HOPTABLE_SIZE];
+extern __xdata uint8_t frsky_chstat_hops;
+extern __xdata uint8_t frsky_chstat_cycles;
+extern __xdata uint8_t frsky_chstat_dump_idx;
+extern __xdata volatile uint8_t frsky_hop_recal_idx;
+extern __xdata volatile uint8_t frsky_hop_recal_active;
+extern __xdata volatile uint8_t frsky_stat_rxovf;
+extern __xdata volatile uint8_t frsky_stat_txunf;
+extern __xdata volatile uint8_t frsky_stat_txtimeout;
+//telemetry slots skipped as the packet was not ready
+extern __xdata volatile uint8_t frsky_stat_txskip;
+//longest run of missed frames while connected
+extern __xdata uint8_t frsky_stat_miss_streak;
+
+//hop scheduler
+extern __xdata volatile uint8_t frsky_hop_state;
+extern __xdata volatile uint8_t frsky_hop_event;
+//the running frame is a telemetry frame (reported with the next hop event)
+extern __xdata uint8_t frsky_hop_telemetry_frame;
+extern __xdata volatile uint8_t frsky_hop_dwell;
+extern __xdata uint16_t frsky_hop_period;
+extern __xdata uint8_t frsky_hop_period_frac;
+extern __xdata uint8_t frsky_hop_frame_ticks;
+extern __xdata uint8_t frsky_hop_stage_ticks;
+extern __xdata uint8_t frsky_hop_frames_since_sync;
+extern __xdata int8_t frsky_hop_phase_error;
+extern __xdata uint8_t frsky_hop_tx_idx;
+extern __xdata uint8_t frsky_hop_tx_counter;
+extern __xdata uint8_t frsky_hop_search_window;
+extern __xdata volatile uint8_t frsky_conn_lost;
+extern __xdata volatile uint8_t frsky_telemetry_pending;
 
 void frsky_init(void);
 void frsky_configure(void);
 void frsky_fetch_txid_and_hoptable(void);
+void frsky_bind_harvest(__xdata uint8_t *packet);
 void frsky_configure_address(void);
 void frsky_calib_pll(void);
+uint8_t frsky_calib_cache_check(uint16_t temperature);
 void frsky_rf_interrupt(void) __interrupt RF_VECTOR;
-void frsky_handle_overflows(void);
+void frsky_tx_start(void);
+void frsky_tx_finish(void);
+void frsky_hop_timer_init(void);
+void frsky_hop_timer_start(void);
+void frsky_hop_timer_sync(uint8_t timestamp, uint8_t counter);
+void frsky_hop_reacquire(void);
+void frsky_hop_timer_interrupt(void) __interrupt T4_VECTOR;
 void frsky_main(void);
+void frsky_rssi_update(uint8_t rssi);
+void frsky_lq_update(uint8_t received);
+void frsky_txpower_set(uint8_t level);
+void frsky_txpower_update(uint8_t missing);
+void frsky_afc_init(void);
+int8_t frsky_afc_clamp(int16_t offset);
+void frsky_chstat_init(void);
+void frsky_chstat_packet(uint8_t hop_idx, __xdata uint8_t *packet);
+void frsky_chstat_hop(void);
+void frsky_chstat_evaluate(void);
+void frsky_chstat_dump(void);
+void frsky_afc_update(int8_t freqest);
+void frsky_afc_store(void);
 void frsky_set_channel(uint8_t hop_index);
-void frsky_update_ppm(void);
+void frsky_update_ppm(__xdata uint8_t *packet);
 void frsky_increment_channel(int8_t cnt);
+void frsky_init_rf_dma(void);
 void frsky_setup_rf_dma(uint8_t);
-uint8_t frsky_extract_rssi(uint8_t rssi_raw);
+void frsky_telemetry_prepare(uint8_t telemetry_id);
+__xdata uint8_t *frsky_rx_fetch(void);
 void frsky_enter_rxmode(uint8_t ch);
 void frsky_frame_sniffer(void);
-uint8_t frsky_append_hub_data(uint8_t sensor_id, uint16_t value, uint8_t *buf);
+uint8_t frsky_append_hub_data(uint8_t sensor_id, uint16_t value);
+uint8_t frsky_hub_used(void);
+void frsky_hub_put(uint8_t val);
+void frsky_hub_put_stuffed(uint8_t val);
+void frsky_hub_end(void);
+void frsky_hub_fill(void);
+void frsky_telemetry_sched_init(void);
+uint16_t frsky_telemetry_sensor_value(uint8_t hub_id);
+uint8_t frsky_hub_build_frame(uint8_t telemetry_id, __xdata volatile uint8_t *buf);
+void frsky_hub_passthrough_init(void);
+void frsky_hub_passthrough_process(void);
+void frsky_hub_passthrough_store(void);
+uint8_t frsky_hub_passthrough_fill(void);
 
 //binding
 uint8_t frsky_bind_jumper_set(void);
+void frsky_autotune(void);
+uint8_t frsky_autotune_freqest(void);
+void frsky_autotune_sweep(void);
+void frsky_autotune_set_offset(int8_t offset);
+__xdata uint8_t *frsky_autotune_wait_bind_packet(uint16_t timeout_ms);
 void frsky_do_bind(void);
 void frsky_store_config(void);
-void frsky_send_telemetry(uint8_t telemetry_id);
 
 #define FRSKY_MODE_RX 0
 #define FRSKY_MODE_TX 1
 
+//hop scheduler (timer 4 in modulo mode, 26MHz/8/128 -> 39.38us per tick)
+#define FRSKY_HOP_US_TO_TICKS(_us) ((((_us)*13L)+256)/512)
+//the tx sends a packet every 9ms
+#define FRSKY_HOP_FRAME_US 9000
+//we hop to the next channel 0.5ms after the end of a valid packet
+//this way we can have up to +/-1ms jitter on our 9ms timebase
+#define FRSKY_HOP_DELAY_US 500
+//strange delay from spi dumps between hop and rx start
+#define FRSKY_HOP_RX_DELAY_US 1000
+//delay between hop and telemetry transmission
+#define FRSKY_HOP_TX_DELAY_US 900
+//8bit tick constants, avoid long arithmetic in interrupts
+#define FRSKY_HOP_DELAY_TICKS    ((uint8_t)FRSKY_HOP_US_TO_TICKS(FRSKY_HOP_DELAY_US))
+#define FRSKY_HOP_RX_DELAY_TICKS ((uint8_t)FRSKY_HOP_US_TO_TICKS(FRSKY_HOP_RX_DELAY_US))
+#define FRSKY_HOP_TX_DELAY_TICKS ((uint8_t)FRSKY_HOP_US_TO_TICKS(FRSKY_HOP_TX_DELAY_US))
+//tracked tx frame period is stored in 1/256 ticks: us * 13/512 * 256
+#define FRSKY_HOP_PERIOD_NOMINAL ((uint16_t)((FRSKY_HOP_FRAME_US*13L)/2))
+//allow +/-2 ticks (~0.9%) deviation from nominal period
+#define FRSKY_HOP_PERIOD_MAX_DEV (2*256)
+//packets more than +/-1ms off the prediction do not update the period
+#define FRSKY_HOP_LOCK_WINDOW ((int8_t)FRSKY_HOP_US_TO_TICKS(1000))
+//maximum search window, ~500ms covers the full 47 channel cycle
+#define FRSKY_HOP_SCAN_FRAMES (500/9)
+//keep following the predicted hop sequence for this many frames without packets
+#define FRSKY_HOP_TRACK_FRAMES 8
+
+//fast autotune: bind packet timeout (ms), a bind packet is sent every 9ms
+#define FRSKY_AUTOTUNE_FREQEST_TIMEOUT 50
+//give up and fall back to a sweep after this many packets
+#define FRSKY_AUTOTUNE_FREQEST_MAX_PACKETS 32
+//residual offset estimate we accept as tuned (1 step = 26MHz/2^14 = 1.6kHz)
+#define FRSKY_AUTOTUNE_FREQEST_TOLERANCE 1
+//number of consecutive packets within tolerance required
+#define FRSKY_AUTOTUNE_FREQEST_LOCK_PACKETS 3
+
+//pll calibration cache: temperature sensor reads ~1 adc lsb per deg c,
+//recalibrate when the (averaged) temperature moved more than this since calibration
+#define FRSKY_CALIB_TEMPERATURE_TOLERANCE 20
+//frsky_calib_cache_check() results
+#define FRSKY_CALIB_CACHE_INVALID     0
+#define FRSKY_CALIB_CACHE_TEMPERATURE 1
+#define FRSKY_CALIB_CACHE_VALID       2
+
+//per channel stats: evaluate once n full hop table cycles are counted (~27s).
+//all counters are halved after that, so the following evaluations happen
+//every n/2 cycles (~13.5s) with the older half weighted in
+#define FRSKY_CHSTAT_WINDOW 64
+//packets expected per hop index within n cycles: the tx does not send in
+//telemetry frames (counter % 4 == 3). 47 and 4 are coprime, so every hop
+//index falls on such a frame once every 4 cycles
+#define FRSKY_CHSTAT_EXPECTED(_cycles) ((_cycles) - ((_cycles) >> 2))
+//recalibrate a channel when its losses exceed twice the average plus this margin
+#define FRSKY_CHSTAT_RECAL_MARGIN 4
+#define FRSKY_CHSTAT_DUMP_DONE 0xFF
+
+//every bind packet carries a slice of 5 hop table entries
+#define FRSKY_BIND_PACKET_COUNT 10
+//done when n times a one
+#define FRSKY_BIND_HOPDATA_DONE ((1<<(FRSKY_BIND_PACKET_COUNT))-1)
+
+//afc: average the offset estimate over this many packets
+#define FRSKY_AFC_PACKETS 32
+//maximum afc correction relative to the bind time offset (steps of 1.6kHz)
+#define FRSKY_AFC_MAX_DEVIATION 16
+//only write the learned offset to flash if it moved more than this
+#define FRSKY_AFC_STORE_THRESHOLD 1
+//write it after the link was lost for this many stat periods (100 hops, ~0.9s)
+#define FRSKY_AFC_STORE_LOST_PERIODS 10
+
+#define FRSKY_HOP_STATE_HOP 0
+#define FRSKY_HOP_STATE_RX  1
+#define FRSKY_HOP_STATE_TX  2
+
+//frsky_hop_event: set by the hop timer when a frame ended
+#define FRSKY_HOP_EVENT_NONE      0
+#define FRSKY_HOP_EVENT_FRAME     1
+//the frame was a telemetry frame, the tx did not send in it
+#define FRSKY_HOP_EVENT_TELEMETRY 2
+
 //packet data example:
 //BIND:   [11 03 01 16 68 14 7E BF 15 56 97 00 00 00 00 00 00 0B F8 AF ]
 //NORMAL: [11 16 68 ... ]
@@ -71,6 +357,17 @@ void frsky_send_telemetry(uint8_t telemetry_id);
 #define FRSKY_HUB_TELEMETRY_VOLTAGE_BEFORE 0x3A
 #define FRSKY_HUB_TELEMETRY_VOLTAGE_AFTER  0x3B
 #define FRSKY_HUB_TELEMETRY_CURRENT        0x28
+#define FRSKY_HUB_TELEMETRY_FUEL           0x04
+#define FRSKY_HUB_TELEMETRY_TEMPERATURE2   0x05
+#define FRSKY_HUB_TELEMETRY_TEMPERATURE1   0x02
+#define FRSKY_HUB_TELEMETRY_RPM            0x03
+#define FRSKY_HUB_TELEMETRY_ACCEL_X        0x24
+#define FRSKY_HUB_TELEMETRY_ACCEL_Y        0x25
+#define FRSKY_HUB_TELEMETRY_ACCEL_Z        0x26
+#define FRSKY_HUB_TELEMETRY_GPS_COURSE     0x14
+#define FRSKY_HUB_TELEMETRY_CELLS          0x06 //first data byte: cell index in the upper nibble
+#define FRSKY_HUB_TELEMETRY_STUFFING       0x5D
+
 
 
 #endif
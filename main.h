@@ -47,6 +47,8 @@
 #define U0GCR_CPHA  (1<<6)
 #define U0GCR_CPOL  (1<<7)
 #define U0CSR_TX_BYTE (1<<1)
+#define U0CSR_RX_BYTE (1<<2)
+#define U0CSR_RE      (1<<6)
 
 #define U1GCR_ORDER (1<<5)
 #define U1GCR_CPHA  (1<<6)
@@ -60,6 +62,15 @@
 #define RFST_SCAL    0x01
 #define RFST_SFSTXON 0x00
 
+#define RFIF_IRQ_TXUNF   (1<<7)
+#define RFIF_IRQ_RXOVF   (1<<6)
+#define RFIF_IRQ_TIMEOUT (1<<5)
+#define RFIF_IRQ_DONE    (1<<4)
+#define RFIM_IM_TXUNF    (1<<7)
+#define RFIM_IM_RXOVF    (1<<6)
+#define RFIM_IM_TIMEOUT  (1<<5)
+#define RFIM_IM_DONE     (1<<4)
+
 //append status
 #define CC2500_PKTCTRL1_APPEND_STATUS     (1<<2)
 //crc autoflush
@@ -105,9 +116,15 @@
 #define ADCCON2_SCH_TEMP       (0b1110<<0)
 #define ADCCON2_SCH_VDD3       (0b1111<<0)
 
+#define ADCCON1_EOC              (1<<7)
 #define ADCCON1_ST               (1<<6)
 #define ADCCON1_STSEL_FULL_SPEED (0b01<<4)
 
+#define SLEEP_RST_MASK     (0b11<<3)
+#define SLEEP_RST_POWER_ON (0b00<<3)
+#define SLEEP_RST_EXTERNAL (0b01<<3)
+#define SLEEP_RST_WATCHDOG (0b10<<3)
+
 #define WDCTL_EN (1<<3)
 #define WDCTL_MODE (1<<2)
 #define WDCTL_INT (0b11)
@@ -149,6 +166,21 @@
 #define T1CCTLx_IM           (1<<6)
 #define T1CCTLx_CPSEL_RF     (1<<7)
 
+#define T4CTL_MODE_FREE_RUNNING (0b00<<0)
+#define T4CTL_MODE_DOWN         (0b01<<0)
+#define T4CTL_MODE_MODULO       (0b10<<0)
+#define T4CTL_MODE_UPDOWN       (0b11<<0)
+#define T4CTL_CLR               (1<<2)
+#define T4CTL_OVFIM             (1<<3)
+#define T4CTL_START             (1<<4)
+#define T4CTL_DIV_1             (0b000<<5)
+#define T4CTL_DIV_32            (0b101<<5)
+#define T4CTL_DIV_64            (0b110<<5)
+#define T4CTL_DIV_128           (0b111<<5)
+
+#define TIMIF_T3OVFIF (1<<0)
+#define TIMIF_T4OVFIF (1<<3)
+
 //add missing defines
 #include <compiler.h>
 SFRX(TEST2,  0xDF23);
@@ -21,6 +21,7 @@
 #include "debug.h"
 #include "wdt.h"
 #include "failsafe.h"
+#include "dma.h"
 
 #if (SBUS_ENABLED == 0)
 
@@ -36,16 +37,35 @@
 #define PPM_INVERTED 1
 
 __xdata volatile uint8_t ppm_output_index;
-__xdata uint16_t ppm_data_ticks[9];
+__xdata uint16_t ppm_data_ticks[2][PPM_SLOTS];
+__xdata volatile uint8_t ppm_data_active;
+__xdata volatile uint8_t ppm_data_pending;
+__xdata volatile uint8_t ppm_gap_active;
+
+#if PPM_USE_DMA
+//point the dma to the active table and restart the reload sequence
+#define PPM_DMA_REARM() { \
+    DMAARM = DMA_ARM_ABORT | DMA_ARM_CH4; \
+    if (ppm_data_active){ \
+        SET_WORD(dma_config[PPM_DMA_CH].SRCADDRH, dma_config[PPM_DMA_CH].SRCADDRL, &ppm_data_ticks[1][0]); \
+    }else{ \
+        SET_WORD(dma_config[PPM_DMA_CH].SRCADDRH, dma_config[PPM_DMA_CH].SRCADDRL, &ppm_data_ticks[0][0]); \
+    } \
+    DMAARM |= DMA_ARM_CH4; }
+#endif
 
 void ppm_init(void){
     uint8_t i;
     debug("ppm: init\n"); debug_flush();
 
     //initialise
-    for(i = 0; i<8; i++){
-        ppm_data_ticks[i] = PPM_US_TO_TICKCOUNT(1000);
+    for(i = 0; i<PPM_CHANNELS; i++){
+        ppm_data_ticks[0][i] = PPM_US_TO_TICKCOUNT(1000);
     }
+    ppm_data_ticks[0][PPM_CHANNELS] = PPM_FRAME_LEN - PPM_CHANNELS*PPM_US_TO_TICKCOUNT(1000);
+    ppm_data_active = 0;
+    ppm_data_pending = 0;
+    ppm_gap_active = 0;
 
     //no int on overflow:
     OVFIM = 0;
@@ -95,25 +115,73 @@ void ppm_init(void){
     //clear pending interrupt flags (IRCON is reset by hw)
     T1CTL &= ~(T1CTL_CH0_IF | T1CTL_CH1_IF | T1CTL_CH2_IF | T1CTL_OVFIF);
 
+    #if PPM_USE_DMA
+    //the dma reloads the timer, no timer ints at all
+    ppm_dma_init();
+    #else
     //overflow causes an int -> reload next channel data
     OVFIM = 1;
 
     //enable T1 interrups
     T1IE = 1;
+    #endif
 
     debug("ppm: init done\n"); debug_flush();
 }
 
 
+#if PPM_USE_DMA
+//the sync pulse ends on the ch2 compare event 0.3ms into every pulse slot.
+//this triggers a word transfer of the next table entry into T1CC0L/H
+//(adjacent, low byte first) which sets the length of the running slot.
+//the dma re-arms itself after PPM_SLOTS transfers and raises one interrupt per frame
+void ppm_dma_init(void){
+    dma_config[PPM_DMA_CH].PRIORITY       = DMA_PRI_LOW;
+    dma_config[PPM_DMA_CH].M8             = DMA_M8_USE_7_BITS;
+    dma_config[PPM_DMA_CH].IRQMASK        = DMA_IRQMASK_ENABLE;
+    dma_config[PPM_DMA_CH].TRIG           = DMA_TRIG_T1_CH2;
+    dma_config[PPM_DMA_CH].TMODE          = DMA_TMODE_SINGLE_REPEATED;
+    dma_config[PPM_DMA_CH].WORDSIZE       = DMA_WORDSIZE_WORD;
+
+    SET_WORD(dma_config[PPM_DMA_CH].SRCADDRH,  dma_config[PPM_DMA_CH].SRCADDRL,  &ppm_data_ticks[0][0]);
+    SET_WORD(dma_config[PPM_DMA_CH].DESTADDRH, dma_config[PPM_DMA_CH].DESTADDRL, &X_T1CC0L);
+    dma_config[PPM_DMA_CH].VLEN           = DMA_VLEN_USE_LEN;
+
+    SET_WORD(dma_config[PPM_DMA_CH].LENH, dma_config[PPM_DMA_CH].LENL, PPM_SLOTS);
+    dma_config[PPM_DMA_CH].SRCINC         = DMA_SRCINC_1;
+    dma_config[PPM_DMA_CH].DESTINC        = DMA_DESTINC_0;
+
+    //set pointer to the DMA configuration struct into DMA-channel 1-4
+    //configuration, should have happened in adc.c already...
+    SET_WORD(DMA1CFGH, DMA1CFGL, &dma_config[1]);
+
+    //dma int, the dma channel done flags of the other channels stay masked
+    DMAIF = 0;
+    DMAIE = 1;
+
+    DMAARM |= DMA_ARM_CH4;
+}
+#endif
+
 void ppm_update(__xdata uint16_t *data){
     uint8_t i=0;
     uint16_t val;
     uint16_t eof_frame_duration = PPM_FRAME_LEN;
+    __xdata uint16_t *ticks;
+    #if PPM_LOW_LATENCY
+    uint16_t gap_end;
+    uint16_t gap_len;
+    #endif
+
+    //no swap while we fill the table. this has to happen before reading
+    //ppm_data_active, afterwards the active table can not change
+    ppm_data_pending = 0;
+    ticks = ppm_data_active ? ppm_data_ticks[0] : ppm_data_ticks[1];
 
     //convert to ticks for timer
     //input is 0..4095, we should map this to 1000..2000us
     //frsky seems to send us*1.5 (~1480...3020) -> divide by 1.5 (=*2/3) to get us
-    for(i = 0; i<8; i++){
+    for(i = 0; i<PPM_CHANNELS; i++){
         val = data[i];
         //convert us to ticks:
         val = PPM_FRSKY_TO_TICKCOUNT(val);
@@ -125,17 +193,48 @@ void ppm_update(__xdata uint16_t *data){
         //subtract from sum:
         eof_frame_duration -= val;
 
-        //set ppm tick data, disable ints during this:
-        cli();
-        ppm_data_ticks[i] = val;
+        //set ppm tick data, this table is not on the output
+        ticks[i] = val;
+    }
+    //never go below the minimum sync gap
+    ticks[PPM_CHANNELS] = max(PPM_SYNC_GAP_MIN_TICKS, eof_frame_duration);
+
+    #if PPM_LOW_LATENCY
+    //the filler up to 20ms is only a timeout now: if we are in the gap, output
+    //this frame right away. the ppm ints/dma will not touch the timer before
+    //the gap ends, the overflow flag tells us if it ended already
+    cli();
+    if (ppm_gap_active && !(T1CTL & T1CTL_OVFIF)){
+        ppm_data_active ^= 1;
+        #if PPM_USE_DMA
+        PPM_DMA_REARM();
+        #endif
+
+        //end the gap now, but not before the minimum gap length
+        gap_end = T1CNTL;
+        gap_end |= ((uint16_t)T1CNTH) << 8;
+        gap_end = max(PPM_SYNC_GAP_MIN_TICKS, gap_end + PPM_GAP_END_MARGIN_TICKS);
+
+        //the running gap was loaded from the old table, only ever shorten it
+        gap_len = T1CC0L;
+        gap_len |= ((uint16_t)T1CC0H) << 8;
+        if (gap_end < gap_len){
+            SET_WORD_LO_FIRST(T1CC0H, T1CC0L, gap_end);
+        }
+        ppm_gap_active = 0;
         sei();
+        return;
     }
-    ppm_data_ticks[8] = eof_frame_duration;
+    sei();
+    #endif
+
+    //output this frame after the running one
+    ppm_data_pending = 1;
 
     //debug("ppm: in "); debug_flush();
     //debug_put_uint16(data[0]);
     //debug(" out ");
-    //debug_put_uint16(ppm_data_ticks[0]);
+    //debug_put_uint16(ticks[0]);
     //debug_put_newline(); debug_flush();
 }
 
@@ -151,19 +250,36 @@ void ppm_exit_failsafe(void){
     //reset counter:
     SET_WORD_LO_FIRST(T1CNTH, T1CNTL, 0);
 
+    //no ppm ints in failsafe, start with the latest frame
+    if (ppm_data_pending){
+        ppm_data_active ^= 1;
+        ppm_data_pending = 0;
+    }
+    ppm_gap_active = 0;
+
+    #if PPM_USE_DMA
+    //restart the reload sequence with the first channel
+    PPM_DMA_REARM();
+    #else
     //re enable timer interrupts:
     OVFIM = 1;
 
     //disable T1 interrups
     T1IE = 1;
+    #endif
 }
 
 void ppm_enter_failsafe(void){
+    #if PPM_USE_DMA
+    //stop reloading the timer
+    DMAARM = DMA_ARM_ABORT | DMA_ARM_CH4;
+    #else
     //disable interrupts
     OVFIM = 0;
 
     //disable T1 interrups
     T1IE = 0;
+    #endif
 
     //configure p0_4 as normal i/o:
     P0SEL &= ~(1<<4);
@@ -180,6 +296,36 @@ void ppm_enter_failsafe(void){
     //debug("ppm: entered FS\n");
 }
 
+#if PPM_USE_DMA
+//dma interrupt, once per ppm frame after the last table entry was loaded.
+//the next load is 0.3ms into the next frame, the filler slot is >= 4ms
+void ppm_dma_interrupt(void) __interrupt DMA_VECTOR{
+    //clear cpu int flag, then the channel flag
+    DMAIF = 0;
+    if (!(DMAIRQ & DMAIRQ_DMAIF4)){
+        //not our channel
+        return;
+    }
+    DMAIRQ &= ~DMAIRQ_DMAIF4;
+
+    //failsafe mode?
+    if (failsafe_active){
+        return;
+    }
+
+    //the gap slot is running, its overflow ends the frame
+    T1CTL &= ~T1CTL_OVFIF;
+    ppm_gap_active = 1;
+
+    //swap tables at the frame boundary. the channel re-armed itself already,
+    //re-arm again in order to load the new source address
+    if (ppm_data_pending){
+        ppm_data_active ^= 1;
+        ppm_data_pending = 0;
+        PPM_DMA_REARM();
+    }
+}
+#else
 //timer1 interrupt, this handles the reloading of the
 //channel data to the timer cmp register
 void ppm_timer1_interrupt(void) __interrupt T1_VECTOR{
@@ -195,23 +341,36 @@ void ppm_timer1_interrupt(void) __interrupt T1_VECTOR{
         return;
     }
 
-    //handle failsafe
-    failsafe_tick();
+    if (ppm_output_index == 0){
+        //the gap ended, start of a new frame. take over new data
+        ppm_gap_active = 0;
+        if (ppm_data_pending){
+            ppm_data_active ^= 1;
+            ppm_data_pending = 0;
+        }
+    }
 
-    if (ppm_output_index < 9){
+    if (ppm_output_index < PPM_SLOTS){
         //load data
-        pulse_len = ppm_data_ticks[ppm_output_index];
+        if (ppm_data_active){
+            pulse_len = ppm_data_ticks[1][ppm_output_index];
+        }else{
+            pulse_len = ppm_data_ticks[0][ppm_output_index];
+        }
     }
 
     //manage index:
     ppm_output_index++;
-    if (ppm_output_index >= 9){
+    if (ppm_output_index >= PPM_SLOTS){
+        //end of frame gap is loaded
         ppm_output_index = 0;
+        ppm_gap_active = 1;
     }
 
     //set overflow cmp value
     SET_WORD_LO_FIRST(T1CC0H, T1CC0L, pulse_len);
 }
+#endif
 
 #endif
 
@@ -7,8 +7,20 @@
 #include "config.h"
 
 #if (SBUS_ENABLED == 0)
+
+#if (PPM_CHANNELS < 1) || (PPM_CHANNELS > 8)
+#error "PPM_CHANNELS must be 1..8"
+#endif
+//one pulse slot per channel plus the end of frame gap
+#define PPM_SLOTS (PPM_CHANNELS + 1)
+
 void ppm_init(void);
+#if PPM_USE_DMA
+void ppm_dma_init(void);
+void ppm_dma_interrupt(void) __interrupt DMA_VECTOR;
+#else
 void ppm_timer1_interrupt(void) __interrupt T1_VECTOR;
+#endif
 
 
 void ppm_update(__xdata uint16_t *data);
@@ -16,11 +28,21 @@ void ppm_exit_failsafe(void);
 void ppm_enter_failsafe(void);
 
 extern __xdata volatile uint8_t ppm_output_index;
-extern __xdata uint16_t ppm_data_ticks[9];
+//double buffered tick tables, ppm_data_ticks[ppm_data_active] is on the output.
+//ppm_update() fills the other one and sets ppm_data_pending, the tables are
+//swapped at the end of a frame only
+extern __xdata uint16_t ppm_data_ticks[2][PPM_SLOTS];
+extern __xdata volatile uint8_t ppm_data_active;
+extern __xdata volatile uint8_t ppm_data_pending;
+//the end of frame gap is on the output
+extern __xdata volatile uint8_t ppm_gap_active;
+
+#if PPM_USE_DMA
+//dma channel that reloads the timer
+#define PPM_DMA_CH 4
+#endif
 
 
-//300us sync pulse
-#define PPM_SYNC_DURATION_US 300
 //from frsky to ticks coresponding to 1000...2000 us
 //frsky seems to send us*1.5 (~1480...3020) -> divide by 1.5 (=*2/3) to get us
 //us -> ticks = ((_us*13)/4) -> (((_frsky*2/3)*13)/4) = ((_frsky*13)/6)
@@ -30,6 +52,9 @@ extern __xdata uint16_t ppm_data_ticks[9];
 #define PPM_US_TO_TICKCOUNT(_us) (((_us<<3)+(_us<<2)+(_us))>>2)
 #define PPM_FRAME_LEN PPM_US_TO_TICKCOUNT(20000L)
 #define PPM_SYNC_PULS_LEN_TICKS (PPM_US_TO_TICKCOUNT(PPM_SYNC_DURATION_US))
+#define PPM_SYNC_GAP_MIN_TICKS  (PPM_US_TO_TICKCOUNT(PPM_SYNC_GAP_MIN_US))
+//an early gap end is set at least this far ahead of the running counter
+#define PPM_GAP_END_MARGIN_TICKS (PPM_US_TO_TICKCOUNT(20))
 
 #endif
 
@@ -27,7 +27,10 @@
 
 #if SBUS_ENABLED
 
-__xdata uint8_t sbus_data[SBUS_DATA_LEN];
+__xdata uint8_t sbus_data[2][SBUS_DATA_LEN];
+__xdata volatile uint8_t sbus_data_active;
+__xdata volatile uint8_t sbus_data_pending;
+__xdata volatile uint8_t sbus_data_age;
 
 //SBUS is:
 //100000bps inverted serial stream, 8 bits, even parity, 2 stop bits
@@ -35,9 +38,20 @@ __xdata uint8_t sbus_data[SBUS_DATA_LEN];
 
 void sbus_init(void){
     __xdata union uart_config_t sbus_uart_config;
+    uint8_t i;
 
     debug("sbus: init\n"); debug_flush();
 
+    //empty frame until the first update, this is sent with the failsafe flag
+    sbus_data[0][0] = SBUS_PREPARE_DATA( SBUS_SYNCBYTE );
+    for(i=1; i<SBUS_DATA_LEN-1; i++){
+        sbus_data[0][i] = SBUS_PREPARE_DATA( 0x00 );
+    }
+    sbus_data[0][SBUS_DATA_LEN-1] = SBUS_PREPARE_DATA( SBUS_ENDBYTE );
+    sbus_data_active = 0;
+    sbus_data_pending = 0;
+    sbus_data_age = 0xFF;
+
     //we will use SERVO_4 as sbus output:
     //therefore we configure
     //USART1 use ALT1 -> Clear flag -> Port P0_4 = TX
@@ -87,9 +101,9 @@ void sbus_init(void){
     dma_config[3].TMODE          = DMA_TMODE_SINGLE;
     dma_config[3].WORDSIZE       = DMA_WORDSIZE_BYTE;
 
-    //important: src addr start is sbus_data[1] as we
-    //initiate the transfer by manually sending sbus_data[0]!
-    SET_WORD(dma_config[3].SRCADDRH,  dma_config[3].SRCADDRL,  &sbus_data[1]);
+    //important: src addr start is sbus_data[x][1] as we
+    //initiate the transfer by manually sending sbus_data[x][0]!
+    SET_WORD(dma_config[3].SRCADDRH,  dma_config[3].SRCADDRL,  &sbus_data[0][1]);
     SET_WORD(dma_config[3].DESTADDRH, dma_config[3].DESTADDRL, &X_U1DBUF);
     dma_config[3].VLEN           = DMA_VLEN_USE_LEN;
 
@@ -111,6 +125,22 @@ void sbus_init(void){
     //start in failsafe mode:
     failsafe_enter();
 
+    //timer 1 sends the frames at a fixed rate, independent of the rf timing.
+    //count up to CC0 then overflow (modulo mode), no compare outputs
+    T1CCTL0 = 0;
+    T1CCTL1 = 0;
+    T1CCTL2 = 0;
+    SET_WORD_LO_FIRST(T1CC0H, T1CC0L, SBUS_FRAME_PERIOD_TICKS - 1);
+    SET_WORD_LO_FIRST(T1CNTH, T1CNTL, 0);
+    T1CTL = T1CTL_MODE_MODULO | T1CTL_DIV_1;
+
+    //clear pending interrupt flags (IRCON is reset by hw)
+    T1CTL &= ~(T1CTL_CH0_IF | T1CTL_CH1_IF | T1CTL_CH2_IF | T1CTL_OVFIF);
+
+    //overflow int starts a transmission
+    OVFIM = 1;
+    T1IE = 1;
+
     debug("sbus: init done\n"); debug_flush();
 }
 
@@ -133,9 +163,29 @@ void sbus_uart_set_mode(__xdata union uart_config_t *cfg){
     IP1 &= ~(1<<3);
 }
 
-void sbus_start_transmission(uint8_t frame_lost){
+//timer1 interrupt, sends the latest frame every SBUS_FRAME_PERIOD_US.
+//a frame takes 3ms, the last transmission is done by now
+void sbus_timer1_interrupt(void) __interrupt T1_VECTOR{
     uint8_t tmp;
-    //debug("sbus: TX\n");
+    __xdata uint8_t *frame;
+
+    //clear pending interrupt flags (IRCON is reset by hw)
+    T1CTL &= ~(T1CTL_CH0_IF | T1CTL_CH1_IF | T1CTL_CH2_IF | T1CTL_OVFIF);
+
+    //take over new data
+    if (sbus_data_pending){
+        sbus_data_active ^= 1;
+        sbus_data_pending = 0;
+        sbus_data_age = 0;
+    }else if (sbus_data_age != 0xFF){
+        sbus_data_age++;
+    }
+
+    if (sbus_data_active){
+        frame = sbus_data[1];
+    }else{
+        frame = sbus_data[0];
+    }
 
     //set up flags:
     //bit 7 = discrete channel 17
@@ -152,20 +202,21 @@ void sbus_start_transmission(uint8_t frame_lost){
         tmp |= SBUS_FLAG_FAILSAFE_ACTIVE;
     }
 
-    //check if this frame was lost
-    if (frame_lost == SBUS_FRAME_LOST){
+    //no fresh data for too long?
+    if (sbus_data_age >= SBUS_FRAME_LOST_AGE){
         tmp |= SBUS_FLAG_FRAME_LOST;
     }
 
     //copy flags to buffer
-    sbus_data[23] = SBUS_PREPARE_DATA( tmp );
+    frame[23] = SBUS_PREPARE_DATA( tmp );
 
     //time to send this frame!
-    //re-arm dma:
+    //re-arm dma, the descriptor is loaded on arming:
+    SET_WORD(dma_config[3].SRCADDRH, dma_config[3].SRCADDRL, &frame[1]);
     DMAARM |= DMA_ARM_CH3;
 
     //send the very first UART byte to trigger a UART TX session:
-    U1DBUF = sbus_data[0];
+    U1DBUF = frame[0];
 }
 
 
@@ -173,6 +224,16 @@ void sbus_update(__xdata uint16_t *data){
     uint8_t i;
     __xdata uint16_t rescaled_data[8];
     int16_t tmp;
+    __xdata uint8_t *sbus_frame;
+
+    //no swap while we fill the frame. this has to happen before reading
+    //sbus_data_active, afterwards the active frame can not change
+    sbus_data_pending = 0;
+    if (sbus_data_active){
+        sbus_frame = sbus_data[0];
+    }else{
+        sbus_frame = sbus_data[1];
+    }
 
     //rescale input data:
     //frsky input is us*1.5
@@ -196,39 +257,42 @@ void sbus_update(__xdata uint16_t *data){
 
     //sbus transmits up to 16 channels with 11bit each.
     //build up channel data frame:
-    sbus_data[ 0] = SBUS_PREPARE_DATA( SBUS_SYNCBYTE );
+    sbus_frame[ 0] = SBUS_PREPARE_DATA( SBUS_SYNCBYTE );
 
     //bits ch 0000 0000
-    sbus_data[ 1] = SBUS_PREPARE_DATA( LO(rescaled_data[0]) );
+    sbus_frame[ 1] = SBUS_PREPARE_DATA( LO(rescaled_data[0]) );
     //bits ch 1111 1000
-    sbus_data[ 2] = SBUS_PREPARE_DATA( (LO(rescaled_data[1])<<3) | HI(rescaled_data[0]) );
+    sbus_frame[ 2] = SBUS_PREPARE_DATA( (LO(rescaled_data[1])<<3) | HI(rescaled_data[0]) );
     //bits ch 2211 1111
-    sbus_data[ 3] = SBUS_PREPARE_DATA( (rescaled_data[1]>>5) | (rescaled_data[2]<<6) );
+    sbus_frame[ 3] = SBUS_PREPARE_DATA( (rescaled_data[1]>>5) | (rescaled_data[2]<<6) );
     //bits ch 2222 2222
-    sbus_data[ 4] = SBUS_PREPARE_DATA( (rescaled_data[2]>>2) & 0xFF );
+    sbus_frame[ 4] = SBUS_PREPARE_DATA( (rescaled_data[2]>>2) & 0xFF );
     //bits ch 3333 3332
-    sbus_data[ 5] = SBUS_PREPARE_DATA( (rescaled_data[2]>>10) | (LO(rescaled_data[3])<<1) );
+    sbus_frame[ 5] = SBUS_PREPARE_DATA( (rescaled_data[2]>>10) | (LO(rescaled_data[3])<<1) );
     //bits ch 4444 3333
-    sbus_data[ 6] = SBUS_PREPARE_DATA( (rescaled_data[3]>>7) | (LO(rescaled_data[4])<<4) );
+    sbus_frame[ 6] = SBUS_PREPARE_DATA( (rescaled_data[3]>>7) | (LO(rescaled_data[4])<<4) );
     //bits ch 5444 4444
-    sbus_data[ 7] = SBUS_PREPARE_DATA( (rescaled_data[4]>>4) | (LO(rescaled_data[5])<<7) );
+    sbus_frame[ 7] = SBUS_PREPARE_DATA( (rescaled_data[4]>>4) | (LO(rescaled_data[5])<<7) );
     //bits ch 5555 5555
-    sbus_data[ 8] = SBUS_PREPARE_DATA( (rescaled_data[5]>>1) & 0xFF );
+    sbus_frame[ 8] = SBUS_PREPARE_DATA( (rescaled_data[5]>>1) & 0xFF );
     //bits ch 6666 6655
-    sbus_data[ 9] = SBUS_PREPARE_DATA( (rescaled_data[5]>>9) | (LO(rescaled_data[6])<<2) );
+    sbus_frame[ 9] = SBUS_PREPARE_DATA( (rescaled_data[5]>>9) | (LO(rescaled_data[6])<<2) );
     //bits ch 7776 6666
-    sbus_data[10] = SBUS_PREPARE_DATA( (rescaled_data[6]>>6) | (LO(rescaled_data[7])<<5) );
+    sbus_frame[10] = SBUS_PREPARE_DATA( (rescaled_data[6]>>6) | (LO(rescaled_data[7])<<5) );
     //bits ch 7777 7777
-    sbus_data[11] = SBUS_PREPARE_DATA( (rescaled_data[7]>>3) & 0xFF );
+    sbus_frame[11] = SBUS_PREPARE_DATA( (rescaled_data[7]>>3) & 0xFF );
     //ch8-ch15 = zero
     for(i=12; i<23; i++){
-        sbus_data[i] = SBUS_PREPARE_DATA( 0x00 );
+        sbus_frame[i] = SBUS_PREPARE_DATA( 0x00 );
     }
     //sbus flags, will be set by start transmission...
-    sbus_data[23] = SBUS_PREPARE_DATA( 0x00 );
+    sbus_frame[23] = SBUS_PREPARE_DATA( 0x00 );
 
     //EOF frame:
-    sbus_data[24] = SBUS_PREPARE_DATA( SBUS_ENDBYTE );
+    sbus_frame[24] = SBUS_PREPARE_DATA( SBUS_ENDBYTE );
+
+    //send this frame next
+    sbus_data_pending = 1;
 }
 
 void sbus_exit_failsafe(void){
@@ -19,7 +19,7 @@
 
 void sbus_init(void);
 void sbus_update(__xdata uint16_t *data);
-void sbus_start_transmission(uint8_t frame_lost);
+void sbus_timer1_interrupt(void) __interrupt T1_VECTOR;
 void sbus_exit_failsafe(void);
 void sbus_enter_failsafe(void);
 void sbus_uart_set_mode(__xdata union uart_config_t *cfg);
@@ -30,14 +30,24 @@ void sbus_uart_set_mode(__xdata union uart_config_t *cfg);
 #define SBUS_BAUD_M 248
 
 #define SBUS_DATA_LEN 25
-extern __xdata uint8_t sbus_data[SBUS_DATA_LEN];
+//double buffered frames, sbus_data[sbus_data_active] is sent by the timer.
+//sbus_update() fills the other one and sets sbus_data_pending
+extern __xdata uint8_t sbus_data[2][SBUS_DATA_LEN];
+extern __xdata volatile uint8_t sbus_data_active;
+extern __xdata volatile uint8_t sbus_data_pending;
+//frames sent since the last update
+extern __xdata volatile uint8_t sbus_data_age;
+
+//timer 1 runs at 3.25MHz (tickspeed /8, set in timeout.c)
+#define SBUS_FRAME_PERIOD_TICKS ((uint16_t)((SBUS_FRAME_PERIOD_US * 13L) / 4))
+//frsky packets come every 9ms, 18ms around a telemetry frame. set the
+//frame lost flag if there was no update for more than 20ms
+#define SBUS_FRAME_LOST_AGE ((20000 / SBUS_FRAME_PERIOD_US) + 1)
 
 #define SBUS_SYNCBYTE 0x0F
 #define SBUS_ENDBYTE  0x00
 #define SBUS_FLAG_FRAME_LOST      (1<<2)
 #define SBUS_FLAG_FAILSAFE_ACTIVE (1<<3)
-#define SBUS_FRAME_LOST 1
-#define SBUS_FRAME_NOT_LOST 0
 
 #endif
 
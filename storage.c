@@ -25,6 +25,7 @@
 
 //persistant storage in flash
 __code __at (STORAGE_LOCATION) uint8_t storage_on_flash[STORAGE_PAGE_SIZE]; //no ini value -> sdcc does not init this!
+__code __at (STORAGE_CALIB_LOCATION) uint8_t storage_calib_on_flash[STORAGE_PAGE_SIZE];
 /* = {
     //this is a trick to fill the flash data with 0xFF on building (saves some time on flashing)
     //sdcc does not support noinit pragme (?)
@@ -38,12 +39,14 @@ __code __at (STORAGE_LOCATION) uint8_t storage_on_flash[STORAGE_PAGE_SIZE]; //no
 
 //run time copy of persistant storage data:
 __xdata STORAGE_DESC storage;
+__xdata STORAGE_CALIB_DESC storage_calib;
 
 void storage_init(void){
     debug("storage: init\n"); debug_flush();
 
     //reload data from flash
     storage_read_from_flash();
+    storage_calib_read_from_flash();
 
     /*frsky_enter_rxmode(0);
     IEN2 &= ~(IEN2_RFIE);
@@ -57,7 +60,7 @@ void storage_init(void){
 
 void storage_read_from_flash(void){
     uint16_t i;
-    uint8_t *storage_ptr = (uint8_t*)storage;
+    uint8_t *storage_ptr = (uint8_t*)&storage;
 
     debug("storage: loading from flash: "); debug_flush();
 
@@ -77,3 +80,20 @@ void storage_write_to_flash(void){
     flash_write((uint16_t)storage_on_flash, (uint8_t*)&storage, sizeof(storage));
 }
 
+void storage_calib_read_from_flash(void){
+    uint16_t i;
+    uint8_t *storage_ptr = (uint8_t*)&storage_calib;
+
+    //copy from persistant flash to ram, no need to dump this
+    for(i=0; i<sizeof(storage_calib); i++){
+        storage_ptr[i] = storage_calib_on_flash[i];
+    }
+}
+
+void storage_calib_write_to_flash(void){
+    debug("storage: writing calib to flash\n"); debug_flush();
+    storage_calib.version = STORAGE_CALIB_VERSION_ID;
+
+    //execute flash write, this only erases the calib page:
+    flash_write((uint16_t)storage_calib_on_flash, (uint8_t*)&storage_calib, sizeof(storage_calib));
+}
@@ -5,18 +5,27 @@
 #include "cc2510fx.h"
 
 #define STORAGE_VERSION_ID 0x01
+#define STORAGE_CALIB_VERSION_ID 0x02
 
 void storage_init(void);
 void storage_write_to_flash(void);
 void storage_read_from_flash(void);
+void storage_calib_write_to_flash(void);
+void storage_calib_read_from_flash(void);
 
 //place data on end of flash
 //FIXME: this is for a cc2510f16 with flash size 0x4000, needs to be adjusted for bigger mcus
 #define STORAGE_PAGE_SIZE 1024
 #define STORAGE_LOCATION (0x4000-STORAGE_PAGE_SIZE)
 
+//the pll calibration cache uses its own page below. it is rewritten more
+//often, an interrupted erase/write there can never destroy the binding
+#define STORAGE_CALIB_LOCATION (STORAGE_LOCATION-STORAGE_PAGE_SIZE)
+//keep the --code-size in the Makefile at or below this address
+
 //place persistant storage:
 extern __code __at (STORAGE_LOCATION) uint8_t storage_on_flash[STORAGE_PAGE_SIZE];
+extern __code __at (STORAGE_CALIB_LOCATION) uint8_t storage_calib_on_flash[STORAGE_PAGE_SIZE];
 
 //our storage struct contains all data that has to be stored on flash
 typedef struct {
@@ -29,6 +38,22 @@ typedef struct {
     //add further data here...
 } STORAGE_DESC;
 
+//pll calibration cache, valid for the given txid, bind offset and temperature
+typedef struct {
+    uint8_t  txid[2];
+    int8_t   freq_offset;
+    uint16_t temperature;
+    uint8_t  fscal1_table[FRSKY_HOPTABLE_SIZE];
+    uint8_t  fscal2;
+    uint8_t  fscal3;
+    //offset learned by the afc in the last flight
+    int8_t   afc_offset;
+    //version id, keep this last: the flash is written in order,
+    //a write cut off by a power loss leaves this erased (0xFF)
+    uint8_t  version;
+} STORAGE_CALIB_DESC;
+
 extern __xdata STORAGE_DESC storage;
+extern __xdata STORAGE_CALIB_DESC storage_calib;
 
 #endif
@@ -0,0 +1,84 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   author: fishpepper <AT> gmail.com
+*/
+
+//host test: integer adc conversions (adc_calc.h) vs. the float formulas
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "adc_calc.h"
+
+//allowed error in output steps (0.1V / 0.1A)
+#define MAX_ERROR 1.0
+
+//reference values are hard coded here on purpose, a wrong constant in
+//adc_calc.h must not pass its own test.
+//the adc result is a signed 10 bit value, single ended inputs only use the
+//positive half: 0..511 covers 0..3.3V (same as the >>7 in adc_get_scaled)
+#define REF_VREF_V      3.3
+#define REF_FULL_SCALE  512
+//acs712-30A: 66mV/A, 0A = 2.5V
+#define REF_ACS712_V_PER_A 0.066
+#define REF_ACS712_ZERO_V  2.5
+
+//adc reading in mV
+static double raw_to_mv(uint16_t raw){
+    return raw * REF_VREF_V * 1000.0 / REF_FULL_SCALE;
+}
+
+//voltage divider input in 0.1V
+static double ref_voltage(uint16_t raw){
+    return raw_to_mv(raw) * (ADC0_DIVIDER_A + ADC0_DIVIDER_B) / ADC0_DIVIDER_B / 100.0;
+}
+
+//acs712 current in 0.1A, negative currents read as 0
+static double ref_current(uint16_t raw, int inverted){
+    double mv = raw_to_mv(raw) - REF_ACS712_ZERO_V * 1000.0;
+    double val;
+
+    if (inverted){
+        mv = -mv;
+    }
+    val = mv * 10.0 / (REF_ACS712_V_PER_A * 1000.0);
+    return (val < 0) ? 0 : val;
+}
+
+static int check(const char *name, uint16_t raw, uint16_t val, double ref){
+    if (fabs(val - ref) > MAX_ERROR){
+        printf("FAIL %s: raw=%u got %u, expected %.3f\n", name, raw, val, ref);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void){
+    uint16_t raw;
+    int failed = 0;
+
+    for(raw=0; raw<REF_FULL_SCALE; raw++){
+        failed += check("voltage", raw, ADC_VOLTAGE_FROM_RAW(raw), ref_voltage(raw));
+        failed += check("current", raw, ADC_ACS712_CURRENT_FROM_RAW(raw), ref_current(raw, 0));
+        failed += check("current inverted", raw, ADC_ACS712_INVERTED_CURRENT_FROM_RAW(raw), ref_current(raw, 1));
+    }
+
+    if (failed){
+        printf("test_adc: %d of %d checks failed\n", failed, 3*REF_FULL_SCALE);
+        return 1;
+    }
+
+    printf("test_adc: %d checks passed\n", 3*REF_FULL_SCALE);
+    return 0;
+}
@@ -23,6 +23,8 @@
 
 //do not place this in xdata (faster this way)
 volatile uint16_t timeout_countdown;
+//free running ms timebase, wraps every 65s
+volatile uint16_t timeout_time_ms;
 
 void timeout_init(void){
     debug("timeout: init\n"); debug_flush();
@@ -30,16 +32,18 @@ void timeout_init(void){
     //timer clock
     CLKCON = (CLKCON & ~CLKCON_TICKSPD_111) | CLKCON_TICKSPD_011;
 
-    //prepare timer3 for 0.01ms steps:
+    //prepare timer3 for 1ms steps:
     //TICKSPD 011 -> /8 = 3250 kHz timer clock input
-    T3CTL = (0b001<<5) | // /2
+    T3CTL = (0b100<<5) | // /16
             (1<<4) |   //start
             (1<<3) |   //OVInt enabled
             (1<<2) |   //clear
             (0b10<<0); // 01 = count to CC and the overflow
 
-    //3250/2/65 = 25khz
-    T3CC0 = 65-1;
+    //3250/16/203 = 1.0006khz
+    T3CC0 = TIMEOUT_T3_PERIOD-1;
+
+    timeout_time_ms = 0;
 
     //enable int
     IEN1 |= (IEN1_T3IE);
@@ -75,6 +79,12 @@ void timeout_set(uint16_t timeout_ms){
     //disable T3ints:
     IEN1 &= ~(IEN1_T3IE);
 
+    //account a pending tick, clearing the counter restarts the current ms.
+    //round the dropped fraction so that the timebase does not drift
+    if (T3IF || (T3CNT >= (TIMEOUT_T3_PERIOD/2))){
+        timeout_time_ms++;
+    }
+
     //clear counter
     T3CTL |= (1<<2);
 
@@ -82,17 +92,22 @@ void timeout_set(uint16_t timeout_ms){
     T3IF = 0;
 
     //prepare timeout val:
-    timeout_countdown = timeout_ms * 25;
+    timeout_countdown = timeout_ms;
 
-    if (timeout_countdown == 0){
-        return;
-    }
+    //re enable interrupts
+    IEN1 |= IEN1_T3IE;
+}
 
-    //clear pending ints
-    T3IF = 0;
+//current time in ms, only valid for differences (wraps)
+uint16_t timeout_time_now(void){
+    uint16_t now;
 
-    //re enable interrupts
+    //disable T3ints for an atomic read
+    IEN1 &= ~(IEN1_T3IE);
+    now = timeout_time_ms;
     IEN1 |= IEN1_T3IE;
+
+    return now;
 }
 
 uint8_t timeout_timed_out(void){
@@ -107,11 +122,10 @@ void timeout_interrupt(void) __interrupt T3_VECTOR{
     //clear flag
     //T3IF = 0;
 
-    if (timeout_countdown == 0){
-        //disable interrupts
-        IEN1 &= ~(IEN1_T3IE);
-        return;
-    }
+    //the timebase keeps running, the timer is never stopped
+    timeout_time_ms++;
 
-    timeout_countdown--;
+    if (timeout_countdown){
+        timeout_countdown--;
+    }
 }
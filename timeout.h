@@ -5,10 +5,15 @@
 #include "main.h"
 
 extern volatile uint16_t timeout_countdown;
+extern volatile uint16_t timeout_time_ms;
+
+//timer3 ticks per ms (3250khz / 16)
+#define TIMEOUT_T3_PERIOD 203
 
 void timeout_init(void);
 void timeout_set(uint16_t timeout_ms);
 uint8_t timeout_timed_out(void);
+uint16_t timeout_time_now(void);
 void timeout_interrupt(void) __interrupt T3_VECTOR;
 
 #endif
@@ -35,6 +35,14 @@ void putchar(char c){
 __xdata uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
 __xdata volatile uint8_t uart_tx_buffer_in;
 __xdata volatile uint8_t uart_tx_buffer_out;
+__xdata uint8_t uart_stat_tx_overflow;
+
+#if FRSKY_HUB_PASSTHROUGH
+__xdata uint8_t uart_rx_buffer[UART_RX_BUFFER_SIZE];
+__xdata volatile uint8_t uart_rx_buffer_in;
+__xdata volatile uint8_t uart_rx_buffer_out;
+__xdata volatile uint8_t uart_rx_lost;
+#endif
 
 void uart_init(void){
     __xdata union uart_config_t uart_config;
@@ -72,6 +80,22 @@ void uart_init(void){
     //init tx buffer
     uart_tx_buffer_in = 0;
     uart_tx_buffer_out = 0;
+    uart_stat_tx_overflow = 0;
+
+    #if FRSKY_HUB_PASSTHROUGH
+    //hub sensor data comes in on P0_2 (RX)
+    P0SEL |= (1<<2);
+    P0DIR &= ~(1<<2);
+
+    uart_rx_buffer_in = 0;
+    uart_rx_buffer_out = 0;
+    uart_rx_lost = 0;
+
+    //enable receiver and rx int
+    URX0IF = 0;
+    U0CSR |= U0CSR_RE;
+    IEN0 |= IEN0_URX0IE;
+    #endif
 
     //enable interrupts:
     sei();
@@ -98,15 +122,14 @@ void uart_putc(uint8_t ch){
     cli();
 
     if (IEN2 & IEN2_UTX0IE){
-        //int already active, copy to buffer!
-        uart_tx_buffer[uart_tx_buffer_in] = ch;
-        uart_tx_buffer_in = (uart_tx_buffer_in + 1) & UART_TX_BUFFER_AND_OPERAND;
-
         //check if free space in buffer:
-        if (uart_tx_buffer_in == uart_tx_buffer_out){
-            //no more space in buffer! this will loose some data!
-            //add LOST data tag (for visual debugging lost data)
+        if (((uart_tx_buffer_in + 1) & UART_TX_BUFFER_AND_OPERAND) == uart_tx_buffer_out){
+            //no more space in buffer! drop this char.
+            //replace the last queued char by a LOST data tag (for visual debugging lost data)
             uart_tx_buffer[(uart_tx_buffer_in-1) & UART_TX_BUFFER_AND_OPERAND] = '$';
+            if (uart_stat_tx_overflow != 0xFF){
+                uart_stat_tx_overflow++;
+            }
 
             /*LED_RED_ON();
             LED_GREEN_OFF();
@@ -118,8 +141,13 @@ void uart_putc(uint8_t ch){
                 LED_GREEN_OFF();
                 delay_ms(200);
             }*/
+            sei();
             return;
         }
+
+        //int already active, copy to buffer!
+        uart_tx_buffer[uart_tx_buffer_in] = ch;
+        uart_tx_buffer_in = (uart_tx_buffer_in + 1) & UART_TX_BUFFER_AND_OPERAND;
     }else{
         //no int active. send first byte and reset buffer indices
         uart_tx_buffer_in  = uart_tx_buffer_out;
@@ -326,3 +354,34 @@ void uart_put_uint16(uint16_t c){
 void uart_put_newline(void){
     uart_putc('\n');
 }
+
+#if FRSKY_HUB_PASSTHROUGH
+void uart_rx_interrupt(void) __interrupt URX0_VECTOR{
+    uint8_t next;
+
+    //reading U0DBUF clears the rx byte flag
+    URX0IF = 0;
+    next = (uart_rx_buffer_in + 1) & UART_RX_BUFFER_AND_OPERAND;
+
+    if (next == uart_rx_buffer_out){
+        //buffer full, drop this byte
+        uart_rx_lost = 1;
+        next = U0DBUF;
+        return;
+    }
+
+    uart_rx_buffer[uart_rx_buffer_in] = U0DBUF;
+    uart_rx_buffer_in = next;
+}
+
+uint8_t uart_rx_available(void){
+    return (uart_rx_buffer_in != uart_rx_buffer_out);
+}
+
+//fetch one byte, check uart_rx_available() first
+uint8_t uart_getc(void){
+    uint8_t ch = uart_rx_buffer[uart_rx_buffer_out];
+    uart_rx_buffer_out = (uart_rx_buffer_out + 1) & UART_RX_BUFFER_AND_OPERAND;
+    return ch;
+}
+#endif
@@ -2,10 +2,17 @@
 #define __UART_H__
 #include "cc2510fx.h"
 #include <stdint.h>
+#include "config.h"
 
+#if FRSKY_HUB_PASSTHROUGH
+//hub sensors use 9600 baud, debug output shares the uart
+#define UART_BAUD_M CC2510_BAUD_M_9600
+#define UART_BAUD_E CC2510_BAUD_E_9600
+#else
 //use 155200 baud
 #define UART_BAUD_M CC2510_BAUD_M_115200
 #define UART_BAUD_E CC2510_BAUD_E_115200
+#endif
 
 union uart_config_t{
   uint8_t byte;
@@ -39,6 +46,21 @@ void putchar(char c);
 
 void uart_tx_interrupt(void) __interrupt UTX0_VECTOR;
 
+#if FRSKY_HUB_PASSTHROUGH
+void uart_rx_interrupt(void) __interrupt URX0_VECTOR;
+uint8_t uart_rx_available(void);
+uint8_t uart_getc(void);
+
+//at 9600 baud this holds ~16ms of data, the main loop polls much faster
+#define UART_RX_BUFFER_SIZE 16
+#define UART_RX_BUFFER_AND_OPERAND (UART_RX_BUFFER_SIZE-1)
+extern __xdata uint8_t uart_rx_buffer[UART_RX_BUFFER_SIZE];
+extern volatile __xdata uint8_t uart_rx_buffer_in;
+extern volatile __xdata uint8_t uart_rx_buffer_out;
+//set by the isr when a byte was dropped, cleared by the reader
+extern volatile __xdata uint8_t uart_rx_lost;
+#endif
+
 #define UART_TX_BUFFER_SIZE 128
 #if ((UART_TX_BUFFER_SIZE==128) || (UART_TX_BUFFER_SIZE==64) || (UART_TX_BUFFER_SIZE==32))
     //ALWAYS use 2^n for buffer size! -> faster code and no int16 in interrupts (see Readme.md)
@@ -50,12 +72,16 @@ void uart_tx_interrupt(void) __interrupt UTX0_VECTOR;
 extern __xdata uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
 extern volatile __xdata uint8_t uart_tx_buffer_in;
 extern volatile __xdata uint8_t uart_tx_buffer_out;
+//characters dropped due to a full tx buffer
+extern __xdata uint8_t uart_stat_tx_overflow;
 
 //for a 26MHz Crystal:
 #define CC2510_BAUD_E_115200 12
 #define CC2510_BAUD_E_57600  11
 #define CC2510_BAUD_M_115200 34
 #define CC2510_BAUD_M_57600  34
+#define CC2510_BAUD_E_9600    8
+#define CC2510_BAUD_M_9600  131
 
 
 #endif
@@ -21,9 +21,17 @@
 #include "led.h"
 #include "delay.h"
 
+__xdata uint8_t wdt_reset_cause;
+
 void wdt_init(void){
     debug("wdt: init\n"); debug_flush();
 
+    //remember why we are here, a watchdog reset means we got stuck somewhere
+    wdt_reset_cause = (SLEEP & SLEEP_RST_MASK) >> 3;
+    debug("wdt: reset cause ");
+    debug_put_uint8(wdt_reset_cause);
+    debug_put_newline();
+
     //check if 32khz clock source is rcosc:
     if (!(CLKCON & CLKCON_OSC32K)){
         debug("wdt: error! low speed clock not based on int rc");
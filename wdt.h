@@ -1,6 +1,11 @@
 #ifndef __WDT_H__
 #define __WDT_H__
 
+#include <stdint.h>
+
+//cause of the last reset, see SLEEP_RST_* (0 = power on, 1 = external, 2 = watchdog)
+extern __xdata uint8_t wdt_reset_cause;
+
 void wdt_init(void);
 void wdt_reset(void);
 